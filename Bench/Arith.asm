@@ -0,0 +1,35 @@
+Tight arithmetic loop.
+Benchmark programs share the layout of Test.asm so they start at 475.
+:label Interrupt_Vector
+:list 3
+
+:label Stack
+:list 20
+
+:label Screen
+:list 450
+
+:label Input
+:number 0
+
+:label Timeout
+:number 0
+
+:label Program
+:copy $0 #[Index]
+:copy $1 #[Value]
+:label Loop
+:add #[Value] #[Index] #[Value]
+:mul #[Value] $3 #[Value]
+:sub #[Value] $7 #[Value]
+:div #[Value] $2 #[Value]
+:and #[Value] $65535 #[Value]
+:or #[Value] $1 #[Value]
+:add #[Index] $1 #[Index]
+:test #[Index] not $1000000 [Loop] {take-no-jump}
+:halt
+
+:label Index
+:number 0
+:label Value
+:number 0
@@ -0,0 +1,61 @@
+Pointer chasing through a linked list of objects.
+Benchmark programs share the layout of Test.asm so they start at 475.
+:label Interrupt_Vector
+:list 3
+
+:label Stack
+:list 20
+
+:label Screen
+:list 450
+
+:label Input
+:number 0
+
+:label Timeout
+:number 0
+
+:object Node next value end
+
+:label Program
+Link each node to another one in a scrambled order.
+:copy $0 #[Index]
+:label Link
+:mul #[Index] $2 #[Address]
+:add #[Address] $[Nodes] #[Address]
+:mul #[Index] $97 #[Next]
+:add #[Next] $1 #[Next]
+:and #[Next] $255 #[Next]
+:mul #[Next] $2 #[Next]
+:add #[Next] $[Nodes] #[Next]
+:copy #[Next] @[Address]
+:add #[Address] $[Node->value] #[Pointer]
+:copy #[Index] @[Pointer]
+:add #[Index] $1 #[Index]
+:test #[Index] not $256 [Link] {take-no-jump}
+Follow the links and add up the values.
+:copy $[Nodes] #[Current]
+:copy $0 #[Index]
+:copy $0 #[Sum]
+:label Chase
+:add #[Current] $[Node->value] #[Pointer]
+:add #[Sum] @[Pointer] #[Sum]
+:copy @[Current] #[Current]
+:add #[Index] $1 #[Index]
+:test #[Index] not $500000 [Chase] {take-no-jump}
+:halt
+
+:label Index
+:number 0
+:label Address
+:number 0
+:label Next
+:number 0
+:label Pointer
+:number 0
+:label Current
+:number 0
+:label Sum
+:number 0
+:label Nodes
+:objects 2x1x256
@@ -0,0 +1,45 @@
+Deep recursion through jsub and return.
+Benchmark programs share the layout of Test.asm so they start at 475.
+:label Interrupt_Vector
+:list 3
+
+:label Stack
+:list 20
+
+:label Screen
+:list 450
+
+:label Input
+:number 0
+
+:label Timeout
+:number 0
+
+:label Program
+:copy $0 #[Round]
+:label Rounds
+:copy $500 #[N]
+:jsub $[Sum]
+:add #[Round] $1 #[Round]
+:test #[Round] not $500 [Rounds] {take-no-jump}
+:halt
+
+:label Round
+:number 0
+:label N
+:number 0
+:label Result
+:number 0
+
+Adds up the numbers from N down to zero by calling itself.
+:label Sum
+:test #[N] = $0 [Sum.Base] {take-no-jump}
+:push #[N]
+:sub #[N] $1 #[N]
+:jsub $[Sum]
+:pop #[N]
+:add #[Result] #[N] #[Result]
+:return
+:label Sum.Base
+:copy $0 #[Result]
+:return
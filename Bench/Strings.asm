@@ -0,0 +1,59 @@
+Draws a string to the screen over and over.
+Benchmark programs share the layout of Test.asm so they start at 475.
+:label Interrupt_Vector
+:list 3
+
+:label Stack
+:list 20
+
+:label Screen
+:list 450
+
+:label Input
+:number 0
+
+:label Timeout
+:number 0
+
+:label Program
+:copy $[Interrupt_Vector] #[Pointer]
+:add #[Pointer] ${screen} #[Pointer]
+:copy $[Screen] @[Pointer]
+:copy $0 #[Frame]
+:label Frames
+:copy $[Hello] #[DS.Pointer]
+:jsub $[Draw_String]
+:add #[Frame] $1 #[Frame]
+:test #[Frame] not $2000 [Frames] {take-no-jump}
+:halt
+
+:label Pointer
+:number 0
+:label Frame
+:number 0
+:label Hello
+:string "The quick brown fox jumps over the lazy dog."
+
+:label DS.Pointer
+:number 0
+:label DS.Count
+:number 0
+:label DS.Index
+:number 0
+:label DS.Screen_Pos
+:number 0
+
+:label Draw_String
+:copy @[DS.Pointer] #[DS.Count]
+:copy $0 #[DS.Index]
+:copy $[Screen] #[DS.Screen_Pos]
+:label DS.Loop
+:test #[DS.Index] = #[DS.Count] [DS.End] {take-no-jump}
+:add #[DS.Pointer] $1 #[DS.Pointer]
+:copy @[DS.Pointer] @[DS.Screen_Pos]
+:add #[DS.Index] $1 #[DS.Index]
+:add #[DS.Screen_Pos] $1 #[DS.Screen_Pos]
+:jump [DS.Loop]
+:label DS.End
+:interrupt {screen}
+:return
@@ -15,18 +15,44 @@ bool Process_Keys();
 // **************************************************************************
 
 int main(int argc, char** argv) {
+  int exit_code = 0;
+  // Take out the options so only the command and its arguments are left.
+  bool stats = false;
+  std::string metrics_file = "";
+  int arg_count = 0;
+  for (int arg_index = 0; arg_index < argc; arg_index++) {
+    std::string arg = argv[arg_index];
+    if (arg == "--stats") {
+      stats = true;
+    }
+    else if (arg.substr(0, 10) == "--metrics=") {
+      metrics_file = arg.substr(10);
+    }
+    else {
+      argv[arg_count++] = argv[arg_index];
+    }
+  }
+  argc = arg_count;
+  if (metrics_file.length() > 0) {
+    Codeloader::metrics.Start_Flushing(metrics_file, METRICS_FLUSH_INTERVAL);
+  }
   // Initialize Allegro.
   try {
-    if (argc == 3) {
+    if ((argc == 3) || (argc == 4)) {
       std::string command = argv[1];
       std::string program = argv[2];
+      bool takes_more = (command == "replay") || (command == "debug") || (command == "client") || (command == "conform");
+      if ((argc == 4) && !takes_more) {
+        throw Codeloader::cError("Command " + command + " does not take " + argv[3] + ".");
+      }
       Codeloader::cConfig config("Config");
       int width = config.Get_Property("width");
       int height = config.Get_Property("height");
-      if (command == "compile") {
+      if ((command == "compile") || (command == "optimize")) {
         Codeloader::cAllegro_IO allegro(program, width, height, 2, "Console");
         simulator = new Codeloader::cSimulator(&allegro, "Config");
         Codeloader::cAssembler assembler(simulator);
+        assembler.linking = (command == "optimize");
         assembler.Load_Source(program);
         assembler.Compile_Source(program);
         delete simulator;
@@ -36,24 +62,121 @@ int main(int argc, char** argv) {
         simulator = new Codeloader::cSimulator(&allegro, "Config");
         simulator->Load_Program(program);
         allegro.Process_Messages(Source_Process, Process_Keys); // Blocks.
+#ifdef CODER_PROFILE
+        simulator->profiler->Save_Report(program);
+#endif
+        delete simulator;
+      }
+      else if (command == "snapshot") {
+        Codeloader::cHeadless_IO headless;
+        simulator = new Codeloader::cSimulator(&headless, "Config");
+        simulator->Load_Program(program);
+        // Run the start up code until the program waits on something.
+        while ((simulator->status == Codeloader::eSTATUS_RUNNING) && !simulator->spinning && !simulator->yielding) {
+          simulator->Run_Slice(HOST_SLICE);
+        }
+        simulator->Save_State(program);
+        delete simulator;
+      }
+      else if (command == "resume") {
+        Codeloader::cAllegro_IO allegro(program, width, height, 2, "Console");
+        simulator = new Codeloader::cSimulator(&allegro, "Config");
+        simulator->Load_State(program);
+        allegro.Process_Messages(Source_Process, Process_Keys); // Blocks.
+        delete simulator;
+      }
+      else if (command == "recover") {
+        Codeloader::cAllegro_IO allegro(program, width, height, 2, "Console");
+        simulator = new Codeloader::cSimulator(&allegro, "Config");
+        simulator->Load_Checkpoint(program);
+        allegro.Process_Messages(Source_Process, Process_Keys); // Blocks.
+        delete simulator;
+      }
+      else if (command == "record") {
+        Codeloader::cAllegro_IO allegro(program, width, height, 2, "Console");
+        simulator = new Codeloader::cSimulator(&allegro, "Config");
+        simulator->Load_Program(program);
+        simulator->trace = new Codeloader::cTrace(program, true, TRACE_INTERVAL);
+        simulator->trace->Record_Checkpoint(simulator); // Replay starts here.
+        try {
+          allegro.Process_Messages(Source_Process, Process_Keys); // Blocks.
+        }
+        catch (Codeloader::cError error) {
+          // Keep everything up to the instruction that failed.
+          simulator->trace->Record_End(simulator->instructions, true);
+          delete simulator;
+          throw;
+        }
+        simulator->trace->Record_End(simulator->instructions, false);
+        delete simulator;
+      }
+      else if (command == "replay") {
+        Codeloader::cHeadless_IO headless;
+        simulator = new Codeloader::cSimulator(&headless, "Config");
+        simulator->trace = new Codeloader::cTrace(program, false, TRACE_INTERVAL);
+        long long target = (argc == 4) ? std::atoll(argv[3]) : simulator->trace->Get_End();
+        simulator->trace->Seek(simulator, target);
+        std::cout << "Replayed to instruction " << simulator->instructions << ": pc=" << simulator->pc << ", sp=" << simulator->sp << ", status=" << simulator->status << std::endl;
+        if (simulator->trace->Has_Failed() && (simulator->instructions == simulator->trace->Get_End())) {
+          std::cout << "The recorded run failed on the next instruction." << std::endl;
+        }
+        simulator->Save_State(program); // Look at it with resume.
+        delete simulator;
+      }
+      else if (command == "debug") {
+        Codeloader::cHeadless_IO headless;
+        simulator = new Codeloader::cSimulator(&headless, "Config");
+        {
+          Codeloader::cDebugger debugger(simulator, program);
+          debugger.Run((argc == 4) ? argv[3] : ""); // Blocks.
+        } // The debugger cleans up before the simulator goes.
         delete simulator;
       }
+      else if (command == "serve") {
+        Codeloader::cServer server(program);
+        server.Run(); // Blocks.
+      }
+      else if (command == "client") {
+        if (argc != 4) {
+          throw Codeloader::cError("Usage: Coder client <socket> <request>");
+        }
+        Codeloader::cServer::Send_Request(program, argv[3]);
+      }
+      else if (command == "conform") {
+        Codeloader::cConformance conformance((argc == 4) ? Codeloader::Text_To_Number(argv[3]) : 1);
+        conformance.Run(Codeloader::Text_To_Number(program), CONFORM_BUDGET); // Blocks.
+      }
+      else if (command == "bench") {
+        Codeloader::cBenchmark benchmark(program);
+        benchmark.Run(); // Blocks.
+      }
+      else if (command == "host") {
+        Codeloader::cHost host;
+        host.Load_Programs(program);
+        host.Run(); // Blocks.
+      }
       else {
         throw Codeloader::cError("Invalid command " + command + ".");
       }
     }
     else {
-      throw Codeloader::cError("Usage: Coder compile | run <program>");
+      throw Codeloader::cError("Usage: Coder compile | optimize | run | snapshot | resume | recover | record <program>, Coder replay | debug <program> [instruction | script], Coder host | bench <list>, Coder serve <socket>, Coder client <socket> <request>, or Coder conform <programs> [seed] for up to 300 seconds, with --stats or --metrics=<file> anywhere");
     }
   }
   catch (Codeloader::cASM_Error asm_error) {
     asm_error.Print();
+    exit_code = 1;
   }
   catch (Codeloader::cError error) {
     error.Print();
+    exit_code = 1; // Lets scripts see that the command failed.
+  }
+  Codeloader::metrics.Stop_Flushing();
+  if (stats) {
+    Codeloader::metrics.Print_Summary();
   }
   std::cout << "Done." << std::endl;
-  return 0;
+  return exit_code;
 }
 
 // ****************************************************************************
@@ -79,6 +202,267 @@ bool Process_Keys() {
 
 namespace Codeloader {
 
+  /**
+   * Gets the assembler name of an instruction.
+   * @param instruction The instruction code.
+   * @return The name of the instruction.
+   */
+  std::string Get_Instruction_Name(int instruction) {
+    switch (instruction) {
+      case eINST_COPY: return "copy";
+      case eINST_ADD: return "add";
+      case eINST_SUB: return "sub";
+      case eINST_MUL: return "mul";
+      case eINST_DIV: return "div";
+      case eINST_TEST: return "test";
+      case eINST_JUMP: return "jump";
+      case eINST_JSUB: return "jsub";
+      case eINST_PUSH: return "push";
+      case eINST_POP: return "pop";
+      case eINST_RETURN: return "return";
+      case eINST_AND: return "and";
+      case eINST_OR: return "or";
+      case eINST_HALT: return "halt";
+      case eINST_INTERRUPT: return "interrupt";
+      case eINST_SPAWN: return "spawn";
+      case eINST_JOIN: return "join";
+      case eINST_CAS: return "cas";
+      case eINST_FETCH_ADD: return "fadd";
+      case eINST_FILL: return "fill";
+      case eINST_MOVE: return "move";
+      case eINST_COMPARE: return "compare";
+      case eINST_VADD: return "vadd";
+      case eINST_VSUB: return "vsub";
+      case eINST_VMUL: return "vmul";
+      case eINST_VAND: return "vand";
+      case eINST_VOR: return "vor";
+      case eINST_VADD_SCALAR: return "vadds";
+      case eINST_VSUB_SCALAR: return "vsubs";
+      case eINST_VMUL_SCALAR: return "vmuls";
+      case eINST_VAND_SCALAR: return "vands";
+      case eINST_VOR_SCALAR: return "vors";
+      case eINST_MOD: return "mod";
+      case eINST_XOR: return "xor";
+      case eINST_SHL: return "shl";
+      case eINST_SHR: return "shr";
+      case eINST_NOT: return "not";
+      case eINST_MAC: return "mac";
+      case eINST_TRAP: return "trap";
+    }
+    return "unknown";
+  }
+
+  /**
+   * Gets the remainder of a division. The remainder has the sign of the left
+   * number. Like division, a zero on the right gives back the left number.
+   * @param left The number to divide.
+   * @param right The number to divide by.
+   * @return The remainder.
+   */
+  int Modulo(int left, int right) {
+    if (right == 0) {
+      return left; // Do not divide!
+    }
+    if (right == -1) {
+      return 0; // The smallest number would overflow.
+    }
+    return left % right;
+  }
+
+  /**
+   * Shifts a number to the left. A negative count shifts to the right and a
+   * count of 32 or more shifts out every bit.
+   * @param value The number to shift.
+   * @param count The number of bits to shift by.
+   * @return The shifted number.
+   */
+  int Shift_Left(int value, int count) {
+    if (count < 0) {
+      return Shift_Right(value, (count < -31) ? 32 : -count);
+    }
+    if (count > 31) {
+      return 0;
+    }
+    return (int)((unsigned int)value << count);
+  }
+
+  /**
+   * Shifts a number to the right keeping its sign. A negative count shifts
+   * to the left and a count of 32 or more leaves only the sign.
+   * @param value The number to shift.
+   * @param count The number of bits to shift by.
+   * @return The shifted number.
+   */
+  int Shift_Right(int value, int count) {
+    if (count < 0) {
+      return Shift_Left(value, (count < -31) ? 32 : -count);
+    }
+    if (count > 31) {
+      return (value < 0) ? -1 : 0;
+    }
+    return (value < 0) ? ~(~value >> count) : (value >> count);
+  }
+
+  // **************************************************************************
+  // Vector Kernels
+  //
+  // The kernels do the same math as the scalar instructions one list
+  // element at a time. Numbers wrap around on overflow just like the scalar
+  // instructions do on the machines we run on. The fastest kernel the CPU
+  // supports is picked the first time one is needed.
+  // **************************************************************************
+
+  /**
+   * Applies an operation to two numbers the way the scalar instructions do.
+   * @param operation The scalar instruction.
+   * @param left The left number.
+   * @param right The right number.
+   * @return The result.
+   */
+  static inline int Apply_Operation(int operation, int left, int right) {
+    switch (operation) {
+      case eINST_ADD: return (int)((unsigned int)left + (unsigned int)right);
+      case eINST_SUB: return (int)((unsigned int)left - (unsigned int)right);
+      case eINST_MUL: return (int)((unsigned int)left * (unsigned int)right);
+      case eINST_AND: return left & right;
+      case eINST_OR: return left | right;
+    }
+    return 0;
+  }
+
+#ifdef VECTOR_X86
+  /**
+   * Runs a vector operation eight numbers at a time.
+   * @return The number of elements that were done.
+   */
+  VECTOR_TARGET("avx2") static int Run_AVX2_Kernel(int operation, int* destination, int* left, int* right, int scalar, int count) {
+    int index = 0;
+    __m256i value = _mm256_set1_epi32(scalar);
+    for (; index + 8 <= count; index += 8) {
+      __m256i a = _mm256_loadu_si256((__m256i*)(left + index));
+      __m256i b = right ? _mm256_loadu_si256((__m256i*)(right + index)) : value;
+      __m256i result;
+      switch (operation) {
+        case eINST_ADD: result = _mm256_add_epi32(a, b); break;
+        case eINST_SUB: result = _mm256_sub_epi32(a, b); break;
+        case eINST_MUL: result = _mm256_mullo_epi32(a, b); break;
+        case eINST_AND: result = _mm256_and_si256(a, b); break;
+        default: result = _mm256_or_si256(a, b); break;
+      }
+      _mm256_storeu_si256((__m256i*)(destination + index), result);
+    }
+    return index;
+  }
+
+  /**
+   * Runs a vector operation four numbers at a time.
+   * @return The number of elements that were done.
+   */
+  VECTOR_TARGET("sse4.1") static int Run_SSE4_Kernel(int operation, int* destination, int* left, int* right, int scalar, int count) {
+    int index = 0;
+    __m128i value = _mm_set1_epi32(scalar);
+    for (; index + 4 <= count; index += 4) {
+      __m128i a = _mm_loadu_si128((__m128i*)(left + index));
+      __m128i b = right ? _mm_loadu_si128((__m128i*)(right + index)) : value;
+      __m128i result;
+      switch (operation) {
+        case eINST_ADD: result = _mm_add_epi32(a, b); break;
+        case eINST_SUB: result = _mm_sub_epi32(a, b); break;
+        case eINST_MUL: result = _mm_mullo_epi32(a, b); break;
+        case eINST_AND: result = _mm_and_si128(a, b); break;
+        default: result = _mm_or_si128(a, b); break;
+      }
+      _mm_storeu_si128((__m128i*)(destination + index), result);
+    }
+    return index;
+  }
+#endif
+
+  static std::atomic<int> vector_level(-1); // Read by every simulator thread.
+
+  /**
+   * Finds the best vector level the CPU supports.
+   * @return The vector level.
+   */
+  int Find_Vector_Level() {
+    int level = eVECTOR_SCALAR;
+#if defined(VECTOR_X86) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    int highest = info[0];
+    __cpuid(info, 1);
+    bool sse4 = (info[2] & (1 << 19)) != 0;
+    bool os_avx = ((info[2] & (1 << 27)) != 0) && ((info[2] & (1 << 28)) != 0) && ((_xgetbv(0) & 6) == 6);
+    bool avx2 = false;
+    if (highest >= 7) {
+      __cpuidex(info, 7, 0);
+      avx2 = os_avx && ((info[1] & (1 << 5)) != 0);
+    }
+    level = avx2 ? eVECTOR_AVX2 : (sse4 ? eVECTOR_SSE4 : eVECTOR_SCALAR);
+#elif defined(VECTOR_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+      level = eVECTOR_AVX2;
+    }
+    else if (__builtin_cpu_supports("sse4.1")) {
+      level = eVECTOR_SSE4;
+    }
+#endif
+    return level;
+  }
+
+  /**
+   * Gets the vector level to run kernels at. The best level the CPU supports
+   * is used unless another one was set.
+   * @return The vector level.
+   */
+  int Get_Vector_Level() {
+    int level = vector_level.load(std::memory_order_relaxed);
+    if (level == -1) {
+      level = Find_Vector_Level(); // Threads that race here find the same level.
+      vector_level.store(level, std::memory_order_relaxed);
+    }
+    return level;
+  }
+
+  /**
+   * Sets the vector level so each kernel can be checked on its own. Other
+   * simulators pick it up on their next kernel, which is safe since every
+   * level gives the same results.
+   * @param level The vector level. It must be supported by the CPU.
+   */
+  void Set_Vector_Level(int level) {
+    vector_level.store(level, std::memory_order_relaxed);
+  }
+
+  /**
+   * Runs a vector operation with the fastest kernel the CPU has.
+   * @param operation The scalar instruction to apply to each element.
+   * @param destination Where the results go.
+   * @param left The left list.
+   * @param right The right list or NULL to use the scalar instead.
+   * @param scalar The right number when there is no right list.
+   * @param count The number of elements.
+   * @return The number of elements that were done.
+   */
+  int Run_Vector_Kernel(int operation, int* destination, int* left, int* right, int scalar, int count) {
+    int index = 0;
+#ifdef VECTOR_X86
+    int level = Get_Vector_Level();
+    if (level == eVECTOR_AVX2) {
+      index = Run_AVX2_Kernel(operation, destination, left, right, scalar, count);
+    }
+    else if (level == eVECTOR_SSE4) {
+      index = Run_SSE4_Kernel(operation, destination, left, right, scalar, count);
+    }
+#endif
+    // Do the rest one at a time.
+    for (; index < count; index++) {
+      destination[index] = Apply_Operation(operation, left[index], right ? right[index] : scalar);
+    }
+    return count;
+  }
+
   // **************************************************************************
   // Assembly Error Implementation
   // **************************************************************************
@@ -97,6 +481,186 @@ namespace Codeloader {
     std::cout << "Error: " << this->message << std::endl;
   }
 
+  // **************************************************************************
+  // Metrics Implementation
+  //
+  // Counters are bumped once per phase, slice, interrupt or screen draw and
+  // never per instruction, so they are always on. Updates are relaxed since
+  // nothing is ordered by them. Times are kept in nanoseconds.
+  // **************************************************************************
+
+  cMetrics metrics;
+
+  /**
+   * Gets the name of a metric.
+   * @param metric The metric.
+   * @return The name used in reports.
+   */
+  std::string Get_Metric_Name(int metric) {
+    switch (metric) {
+      case eMETRIC_CONFIG_TIME: return "config_ns";
+      case eMETRIC_TOKENIZE_TIME: return "tokenize_ns";
+      case eMETRIC_PARSE_TIME: return "parse_ns";
+      case eMETRIC_RESOLVE_TIME: return "resolve_ns";
+      case eMETRIC_LINK_TIME: return "link_ns";
+      case eMETRIC_SAVE_TIME: return "save_ns";
+      case eMETRIC_LOAD_TIME: return "load_ns";
+      case eMETRIC_INSTRUCTIONS: return "instructions";
+      case eMETRIC_RUNS: return "runs";
+      case eMETRIC_RUN_OVERSHOOT: return "run_overshoot_ns";
+      case eMETRIC_RUN_OVERSHOOT_MAX: return "run_overshoot_max_ns";
+      case eMETRIC_INTERRUPT_SCREEN: return "interrupt_screen";
+      case eMETRIC_INTERRUPT_INPUT: return "interrupt_input";
+      case eMETRIC_INTERRUPT_TIMEOUT: return "interrupt_timeout";
+      case eMETRIC_DRAW_TIME: return "draw_ns";
+      case eMETRIC_CELLS_DRAWN: return "cells_drawn";
+    }
+    return "unknown";
+  }
+
+  /**
+   * Creates the metrics with every counter at zero.
+   */
+  cMetrics::cMetrics() {
+    for (int metric = 0; metric < eMETRIC_COUNT; metric++) {
+      this->counters[metric] = 0;
+    }
+    this->file = "";
+    this->flusher = NULL;
+    this->stopping = false;
+  }
+
+  /**
+   * Stops the flusher if it is still going.
+   */
+  cMetrics::~cMetrics() {
+    this->Stop_Flushing();
+  }
+
+  /**
+   * Adds to a counter.
+   * @param metric The counter.
+   * @param amount The amount to add.
+   */
+  void cMetrics::Add(int metric, long long amount) {
+    this->counters[metric].fetch_add(amount, std::memory_order_relaxed);
+  }
+
+  /**
+   * Adds the time since a start time to a counter.
+   * @param metric The counter.
+   * @param start When the timed phase started.
+   */
+  void cMetrics::Add_Time(int metric, std::chrono::steady_clock::time_point start) {
+    std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - start;
+    this->Add(metric, (long long)elapsed.count());
+  }
+
+  /**
+   * Raises a counter that keeps the biggest value seen.
+   * @param metric The counter.
+   * @param value The value to compare with.
+   */
+  void cMetrics::Raise(int metric, long long value) {
+    long long current = this->counters[metric].load(std::memory_order_relaxed);
+    while ((value > current) && !this->counters[metric].compare_exchange_weak(current, value, std::memory_order_relaxed));
+  }
+
+  /**
+   * Starts writing the metrics to a JSON file on a timer. The file is also
+   * written when flushing stops.
+   * @param file The name of the file.
+   * @param interval The time between writes in milliseconds.
+   */
+  void cMetrics::Start_Flushing(std::string file, int interval) {
+    this->file = file;
+    this->stopping = false;
+    this->flusher = new std::thread(&cMetrics::Flush_Loop, this, interval);
+  }
+
+  /**
+   * Writes the metrics until flushing stops.
+   * @param interval The time between writes in milliseconds.
+   */
+  void cMetrics::Flush_Loop(int interval) {
+    std::unique_lock<std::mutex> guard(this->lock);
+    while (!this->stopping) {
+      this->wake.wait_for(guard, std::chrono::milliseconds(interval));
+      try {
+        this->Flush();
+      }
+      catch (cError error) {
+        error.Print();
+        return; // Do not fill the console with the same error.
+      }
+    }
+  }
+
+  /**
+   * Stops the flusher and writes the metrics one last time.
+   */
+  void cMetrics::Stop_Flushing() {
+    if (this->flusher) {
+      {
+        std::lock_guard<std::mutex> guard(this->lock);
+        this->stopping = true;
+      }
+      this->wake.notify_all();
+      this->flusher->join(); // Writes on the way out.
+      delete this->flusher;
+      this->flusher = NULL;
+    }
+  }
+
+  /**
+   * Writes the metrics to the file as one JSON object. The object is written
+   * next to the file and renamed over it so a reader never sees half of it.
+   * @throws An error if the file could not be written.
+   */
+  void cMetrics::Flush() {
+    std::string temp_name = this->file + ".tmp";
+    std::ofstream metrics_file(temp_name);
+    if (!metrics_file) {
+      throw cError("Could not write metrics to " + this->file + ".");
+    }
+    metrics_file << "{";
+    for (int metric = 0; metric < eMETRIC_COUNT; metric++) {
+      metrics_file << ((metric > 0) ? ", " : "") << "\"" << Get_Metric_Name(metric) << "\": " << this->counters[metric].load(std::memory_order_relaxed);
+    }
+    metrics_file << "}" << std::endl;
+    metrics_file.close();
+    if (!metrics_file) {
+      std::remove(temp_name.c_str());
+      throw cError("Could not write metrics to " + this->file + ".");
+    }
+#ifdef _WIN32
+    std::remove(this->file.c_str()); // Windows will not rename over a file.
+#endif
+    if (std::rename(temp_name.c_str(), this->file.c_str()) != 0) {
+      throw cError("Could not write metrics to " + this->file + ".");
+    }
+  }
+
+  /**
+   * Prints every counter. Times are shown in milliseconds.
+   */
+  void cMetrics::Print_Summary() {
+    std::cout << "Stats:" << std::endl;
+    for (int metric = 0; metric < eMETRIC_COUNT; metric++) {
+      std::string name = Get_Metric_Name(metric);
+      long long value = this->counters[metric].load(std::memory_order_relaxed);
+      std::size_t unit = name.rfind("_ns");
+      if (unit != std::string::npos) {
+        char buffer[32];
+        std::snprintf(buffer, sizeof(buffer), "%.3f", (double)value / 1000000.0);
+        std::cout << "  " << name.substr(0, unit) << ": " << buffer << " ms" << std::endl;
+      }
+      else {
+        std::cout << "  " << name << ": " << value << std::endl;
+      }
+    }
+  }
+
   // **************************************************************************
   // Memory Implementation
   // **************************************************************************
@@ -107,17 +671,40 @@ namespace Codeloader {
    */
   cMemory::cMemory(int size) {
     this->count = size;
+    this->writes = 0;
     this->memory = new int[size];
     for (int index = 0; index < size; index++) {
       this->memory[index] = 0;
     }
+    this->page_count = (size + MEMORY_PAGE_SIZE - 1) / MEMORY_PAGE_SIZE;
+    this->page_traps = new unsigned char[this->page_count];
+    this->saved_pages = new int*[this->page_count];
+    this->dirty_pages = new unsigned char[this->page_count];
+    this->dirty_list = new int[this->page_count];
+    this->watch_counts = new int[this->page_count];
+    for (int page_index = 0; page_index < this->page_count; page_index++) {
+      this->page_traps[page_index] = 0;
+      this->saved_pages[page_index] = NULL;
+      this->dirty_pages[page_index] = 0;
+      this->watch_counts[page_index] = 0;
+    }
+    this->snapshot = false;
+    this->dirty_count = 0;
+    this->tracking = false;
+    this->watch_flag = NULL;
   }
 
   /**
    * Frees up the memory.
    */
   cMemory::~cMemory() {
+    this->Drop_Snapshot();
     delete[] this->memory;
+    delete[] this->page_traps;
+    delete[] this->saved_pages;
+    delete[] this->dirty_pages;
+    delete[] this->dirty_list;
+    delete[] this->watch_counts;
   }
 
   /**
@@ -128,7 +715,7 @@ namespace Codeloader {
   int cMemory::Read_Number(int address) {
     int number = 0;
     if ((address >= 0) && (address < this->count)) {
-      number = this->memory[address];
+      number = std::atomic_ref<int>(this->memory[address]).load(std::memory_order_relaxed);
       // std::cout << "cell=" << number << ", address=" << address << std::endl;
     }
     else {
@@ -145,7 +732,13 @@ namespace Codeloader {
    */
   void cMemory::Write_Number(int address, int value) {
     if ((address >= 0) && (address < this->count)) {
-      this->memory[address] = value;
+      if (this->Is_Trapped(address >> MEMORY_PAGE_SHIFT)) {
+        this->Trap_Write(address >> MEMORY_PAGE_SHIFT);
+      }
+      std::atomic_ref<int>(this->memory[address]).store(value, std::memory_order_relaxed);
+      // Lets simulators know that memory has changed. This is not a locked
+      // increment since any change to the count is enough.
+      this->writes.store(this->writes.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
     }
     else {
       throw cError("Invalid memory write at " + Number_To_Text(address) + ".");
@@ -153,92 +746,539 @@ namespace Codeloader {
   }
 
   /**
-   * Clears out the memory.
+   * Atomically replaces a number if it has the expected value.
+   * @param address The address of the number.
+   * @param expected The value the number must have.
+   * @param value The value to write if the number matched.
+   * @return The number that was in memory before the swap.
+   * @throws An error if the memory address is invalid.
    */
-  void cMemory::Clear() {
-    for (int index = 0; index < this->count; index++) {
-      this->memory[index] = 0;
+  int cMemory::Compare_And_Swap(int address, int expected, int value) {
+    if ((address < 0) || (address >= this->count)) {
+      throw cError("Invalid memory write at " + Number_To_Text(address) + ".");
+    }
+    if (this->Is_Trapped(address >> MEMORY_PAGE_SHIFT)) {
+      this->Trap_Write(address >> MEMORY_PAGE_SHIFT); // Even if nothing is swapped.
+    }
+    int number = expected;
+    if (std::atomic_ref<int>(this->memory[address]).compare_exchange_strong(number, value)) {
+      this->writes.store(this->writes.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
     }
+    return number;
   }
 
-  // **************************************************************************
-  // Simulator Implementation
-  // **************************************************************************
+  /**
+   * Atomically adds to a number.
+   * @param address The address of the number.
+   * @param amount The amount to add.
+   * @return The number that was in memory before the add.
+   * @throws An error if the memory address is invalid.
+   */
+  int cMemory::Fetch_And_Add(int address, int amount) {
+    if ((address < 0) || (address >= this->count)) {
+      throw cError("Invalid memory write at " + Number_To_Text(address) + ".");
+    }
+    if (this->Is_Trapped(address >> MEMORY_PAGE_SHIFT)) {
+      this->Trap_Write(address >> MEMORY_PAGE_SHIFT);
+    }
+    int number = std::atomic_ref<int>(this->memory[address]).fetch_add(amount); // Wraps around.
+    this->writes.store(this->writes.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    return number;
+  }
 
   /**
-   * Creates a new simulator.
-   * @param io The I/O control reference.
-   * @param config The name of the config file.
-   * @throws An error if the config file could not be found.
+   * Checks that a range of addresses is inside the memory.
+   * @param address The first address.
+   * @param count The number of units.
+   * @throws An error if any part of the range is outside the memory.
    */
-  cSimulator::cSimulator(cIO_Control* io, std::string config) {
-    this->io = io;
-    this->pc = 0;
-    this->sp = 0;
-    this->status = eSTATUS_IDLE;
-    this->memory = NULL;
-    this->interrupt_pointer = 0;
-    this->width = 400;
-    this->height = 300;
-    this->letter_w = 16;
-    this->letter_h = 16;
-    // Read the configuration file.
-    cFile config_file(config + ".txt");
-    config_file.Read();
-    int memory_size = 200;
-    while (config_file.Has_More_Lines()) {
-      std::string line = config_file.Get_Line();
-      cArray<std::string> pair = Parse_Sausage_Text(line, "=");
-      if (pair.Count() == 2) {
-        if (pair[0] == "letter-w") {
-          this->letter_w = Text_To_Number(pair[1]);
-        }
-        else if (pair[0] == "letter-h") {
-          this->letter_h = Text_To_Number(pair[1]);
-        }
-        else if (pair[0] == "width") {
-          this->width = Text_To_Number(pair[1]);
-        }
-        else if (pair[0] == "height") {
-          this->height = Text_To_Number(pair[1]);
-        }
-        else if (pair[0] == "interrupt") {
-          this->interrupt_pointer = Text_To_Number(pair[1]);
-        }
-        else if (pair[0] == "memory") {
-          memory_size = Text_To_Number(pair[1]);
-        }
-        else if (pair[0] == "program") {
-          this->pc = Text_To_Number(pair[1]);
-        }
-        else if (pair[0] == "stack") {
-          this->sp = Text_To_Number(pair[1]);
-        }
-        else {
-          throw cError("Invalid configuration property " + pair[0] + ".");
+  void cMemory::Check_Range(int address, int count) {
+    if (count < 0) {
+      throw cError("Invalid count " + Number_To_Text(count) + ".");
+    }
+    if ((address < 0) || (address > this->count - count)) {
+      throw cError("Invalid memory access at " + Number_To_Text(address) + " for " + Number_To_Text(count) + " units.");
+    }
+  }
+
+  /**
+   * Gets a range of memory ready to be written all at once. This does for
+   * the whole range what Write_Number does for a single number.
+   * @param address The first address.
+   * @param count The number of units.
+   */
+  void cMemory::Touch_Range(int address, int count) {
+    if (count > 0) {
+      int last_page = (address + count - 1) >> MEMORY_PAGE_SHIFT;
+      for (int page_index = address >> MEMORY_PAGE_SHIFT; page_index <= last_page; page_index++) {
+        if (this->Is_Trapped(page_index)) {
+          this->Trap_Write(page_index);
         }
       }
-      // Anything that is not a pair is a comment.
+      this->writes.store(this->writes.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
     }
-    // Apply settings.
-    this->memory = new cMemory(memory_size);
   }
 
   /**
-   * Frees the simulator.
+   * Fills a range of memory with a value.
+   * @param address The first address.
+   * @param value The value to fill with.
+   * @param count The number of units.
+   * @throws An error if the range is invalid.
    */
-  cSimulator::~cSimulator() {
-    if (this->memory) {
-      delete this->memory;
-    }
+  void cMemory::Fill(int address, int value, int count) {
+    this->Check_Range(address, count);
+    this->Touch_Range(address, count);
+    std::fill_n(this->memory + address, count, value);
   }
 
   /**
-   * Loads a program to the memory.
-   * @param name The name of the program to load.
-   * @throws An error if the program could not be loaded.
+   * Moves a range of memory. The ranges may overlap.
+   * @param source The first address to move from.
+   * @param destination The first address to move to.
+   * @param count The number of units.
+   * @throws An error if either range is invalid.
+   */
+  void cMemory::Move(int source, int destination, int count) {
+    this->Check_Range(source, count);
+    this->Check_Range(destination, count);
+    this->Touch_Range(destination, count);
+    std::memmove(this->memory + destination, this->memory + source, count * sizeof(int));
+  }
+
+  /**
+   * Compares two ranges of memory.
+   * @param left The first address of the left range.
+   * @param right The first address of the right range.
+   * @param count The number of units.
+   * @return Zero if the ranges match. Otherwise -1 if the first number that
+   * differs is smaller on the left and 1 if it is bigger.
+   * @throws An error if either range is invalid.
+   */
+  int cMemory::Compare(int left, int right, int count) {
+    this->Check_Range(left, count);
+    this->Check_Range(right, count);
+    std::pair<int*, int*> difference = std::mismatch(this->memory + left, this->memory + left + count, this->memory + right);
+    if (difference.first == this->memory + left + count) {
+      return 0;
+    }
+    return (*difference.first < *difference.second) ? -1 : 1;
+  }
+
+  /**
+   * Applies an operation to each element of a list.
+   * @param operation The scalar instruction to apply.
+   * @param left The first address of the left list.
+   * @param right The first address of the right list or the scalar value.
+   * @param destination The first address of the results.
+   * @param count The number of elements.
+   * @param scalar True if right is a value instead of a list.
+   * @throws An error if any list is outside the memory.
+   */
+  void cMemory::Vector(int operation, int left, int right, int destination, int count, bool scalar) {
+    this->Check_Range(left, count);
+    if (!scalar) {
+      this->Check_Range(right, count);
+    }
+    this->Check_Range(destination, count);
+    this->Touch_Range(destination, count);
+    int* right_list = scalar ? NULL : this->memory + right;
+    // A result written ahead of where a list is read would be read back one
+    // element at a time, so do that case in order.
+    bool left_overlap = (destination > left) && (destination < left + count);
+    bool right_overlap = !scalar && (destination > right) && (destination < right + count);
+    if (left_overlap || right_overlap) {
+      for (int index = 0; index < count; index++) {
+        int right_value = scalar ? right : this->memory[right + index];
+        this->memory[destination + index] = Apply_Operation(operation, this->memory[left + index], right_value);
+      }
+    }
+    else {
+      Run_Vector_Kernel(operation, this->memory + destination, this->memory + left, right_list, right, count);
+    }
+  }
+
+  /**
+   * Clears out the memory. Counts as a write so parked simulators look again.
+   */
+  void cMemory::Clear() {
+    for (int page_index = 0; page_index < this->page_count; page_index++) {
+      if (this->page_traps[page_index]) {
+        this->Trap_Write(page_index);
+      }
+    }
+    for (int index = 0; index < this->count; index++) {
+      std::atomic_ref<int>(this->memory[index]).store(0, std::memory_order_relaxed);
+    }
+    this->writes.store(this->writes.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  }
+
+  /**
+   * Handles the first write to a page that is being watched. The page is
+   * copied if a snapshot needs it and marked dirty if pages are tracked.
+   * Pages with watchpoints stay armed and raise the watch flag on every write.
+   * @param page The page number.
+   */
+  void cMemory::Trap_Write(int page) {
+    std::lock_guard<std::mutex> guard(this->page_lock);
+    if (this->snapshot && !this->saved_pages[page]) {
+      int start = page * MEMORY_PAGE_SIZE;
+      int size = std::min(MEMORY_PAGE_SIZE, this->count - start);
+      this->saved_pages[page] = new int[MEMORY_PAGE_SIZE];
+      std::memcpy(this->saved_pages[page], this->memory + start, size * sizeof(int));
+    }
+    this->Mark_Dirty(page);
+    if (this->watch_counts[page] > 0) {
+      if (this->watch_flag) {
+        *this->watch_flag = true;
+      }
+      return; // Keep trapping.
+    }
+    this->Set_Trap(page, false);
+  }
+
+  /**
+   * Arms the write trap for a page if anything still needs to see a write.
+   * @param page The page number.
+   */
+  void cMemory::Update_Trap(int page) {
+    bool save = this->snapshot && !this->saved_pages[page];
+    bool track = this->tracking && !this->dirty_pages[page];
+    bool watch = (this->watch_counts[page] > 0);
+    this->Set_Trap(page, save || track || watch);
+  }
+
+  /**
+   * Determines if writes to a page trap. Other threads may be arming or
+   * clearing the trap at the same time.
+   * @param page The page number.
+   * @return True if the page traps, false otherwise.
+   */
+  bool cMemory::Is_Trapped(int page) {
+    return (std::atomic_ref<unsigned char>(this->page_traps[page]).load(std::memory_order_relaxed) != 0);
+  }
+
+  /**
+   * Arms or clears the write trap for a page.
+   * @param page The page number.
+   * @param trapped True to arm the trap.
+   */
+  void cMemory::Set_Trap(int page, bool trapped) {
+    std::atomic_ref<unsigned char>(this->page_traps[page]).store(trapped ? 1 : 0, std::memory_order_relaxed);
+  }
+
+  /**
+   * Sleeps a thread that is spinning until memory may have changed or the
+   * thread is stopped. Writers do not wake sleepers since waking on every
+   * write makes a busy writer and a spinning reader take turns on the CPU.
+   * The sleeper looks at the write count again after a short wait instead.
+   * @param seen The write count the waiting thread last saw.
+   * @param stopping The stop flag of the waiting thread.
+   */
+  void cMemory::Wait_For_Write(int seen, std::atomic<bool>& stopping) {
+    std::unique_lock<std::mutex> guard(this->sleep_lock);
+    if ((this->writes.load(std::memory_order_relaxed) == seen) && !stopping) {
+      this->wake.wait_for(guard, std::chrono::milliseconds(THREAD_WAIT));
+    }
+  }
+
+  /**
+   * Wakes up every sleeping thread so it can see it was stopped.
+   */
+  void cMemory::Wake_Sleepers() {
+    std::lock_guard<std::mutex> guard(this->sleep_lock);
+    this->wake.notify_all();
+  }
+
+
+  /**
+   * Determines if a page has nothing but zeros.
+   * @param page The page number.
+   * @return True if the page is clear, false otherwise.
+   */
+  bool cMemory::Is_Page_Clear(int page) {
+    int start = page * MEMORY_PAGE_SIZE;
+    int end = std::min(start + MEMORY_PAGE_SIZE, this->count);
+    for (int index = start; index < end; index++) {
+      if (this->memory[index] != 0) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /**
+   * Takes a copy-on-write snapshot. Nothing is copied now. Each page is
+   * copied the first time it is written so the cost depends on how much
+   * memory changes, not on how big the memory is.
+   */
+  void cMemory::Take_Snapshot() {
+    this->Drop_Snapshot();
+    this->snapshot = true;
+    for (int page_index = 0; page_index < this->page_count; page_index++) {
+      this->Update_Trap(page_index);
+    }
+  }
+
+  /**
+   * Puts back every page that changed since the snapshot. The snapshot stays
+   * so it can be restored again.
+   */
+  void cMemory::Restore_Snapshot() {
+    if (!this->snapshot) {
+      throw cError("There is no snapshot to restore.");
+    }
+    for (int page_index = 0; page_index < this->page_count; page_index++) {
+      if (this->saved_pages[page_index]) {
+        int start = page_index * MEMORY_PAGE_SIZE;
+        int size = std::min(MEMORY_PAGE_SIZE, this->count - start);
+        std::memcpy(this->memory + start, this->saved_pages[page_index], size * sizeof(int));
+        // The next delta has to carry the rollback.
+        this->Mark_Dirty(page_index);
+        this->Update_Trap(page_index);
+      }
+    }
+    this->writes.store(this->writes.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  }
+
+  /**
+   * Frees the snapshot.
+   */
+  void cMemory::Drop_Snapshot() {
+    for (int page_index = 0; page_index < this->page_count; page_index++) {
+      if (this->saved_pages[page_index]) {
+        delete[] this->saved_pages[page_index];
+        this->saved_pages[page_index] = NULL;
+      }
+    }
+    this->snapshot = false;
+    for (int page_index = 0; page_index < this->page_count; page_index++) {
+      this->Update_Trap(page_index);
+    }
+  }
+
+  /**
+   * Starts tracking which pages are written. Every page starts out clean.
+   */
+  void cMemory::Track_Dirty() {
+    this->tracking = true;
+    this->Clear_Dirty();
+    for (int page_index = 0; page_index < this->page_count; page_index++) {
+      this->Update_Trap(page_index);
+    }
+  }
+
+  /**
+   * Marks all dirty pages as clean again. Only the pages that were written
+   * are visited.
+   */
+  void cMemory::Clear_Dirty() {
+    for (int dirty_index = 0; dirty_index < this->dirty_count; dirty_index++) {
+      int page = this->dirty_list[dirty_index];
+      this->dirty_pages[page] = 0;
+      this->Update_Trap(page);
+    }
+    this->dirty_count = 0;
+  }
+
+  /**
+   * Marks a page as dirty if pages are being tracked.
+   * @param page The page number.
+   */
+  void cMemory::Mark_Dirty(int page) {
+    if (this->tracking && !this->dirty_pages[page]) {
+      this->dirty_pages[page] = 1;
+      this->dirty_list[this->dirty_count++] = page;
+    }
+  }
+
+  /**
+   * Watches an address for writes. The whole page traps so writes to other
+   * pages still cost nothing.
+   * @param address The address to watch.
+   * @throws An error if the address is invalid.
+   */
+  void cMemory::Watch(int address) {
+    this->Check_Range(address, 1);
+    int page = address >> MEMORY_PAGE_SHIFT;
+    this->watch_counts[page]++;
+    this->Update_Trap(page);
+  }
+
+  /**
+   * Stops watching an address.
+   * @param address The address that was watched.
+   */
+  void cMemory::Unwatch(int address) {
+    int page = address >> MEMORY_PAGE_SHIFT;
+    if ((page >= 0) && (page < this->page_count) && (this->watch_counts[page] > 0)) {
+      this->watch_counts[page]--;
+      this->Update_Trap(page);
+    }
+  }
+
+  // **************************************************************************
+  // Simulator Implementation
+  // **************************************************************************
+
+  /**
+   * Creates a new simulator.
+   * @param io The I/O control reference.
+   * @param config The name of the config file.
+   * @throws An error if the config file could not be found.
+   */
+  cSimulator::cSimulator(cIO_Control* io, std::string config) {
+    this->io = io;
+    this->pc = 0;
+    this->sp = 0;
+    this->status = eSTATUS_IDLE;
+    this->memory = NULL;
+    this->interrupt_pointer = 0;
+    this->width = 400;
+    this->height = 300;
+    this->letter_w = 16;
+    this->letter_h = 16;
+    this->spinning = false;
+    this->spin_writes = 0;
+    this->spin_sp = 0;
+    this->spin_count = 0;
+    this->spin_input = false;
+    this->yielding = false;
+    this->debugging = false;
+    this->breaking = false;
+    this->instructions = 0;
+    this->parent = NULL;
+    this->stopping = false;
+    this->checkpoint_interval = 0;
+    this->compact_interval = 8;
+    this->delta_count = 0;
+    this->generation = 0;
+    this->next_checkpoint = 0;
+    this->trace = NULL;
+#ifdef CODER_PROFILE
+    this->profiler = NULL;
+#endif
+    // Read the configuration file.
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    cFile config_file(config + ".txt");
+    config_file.Read();
+    int memory_size = 200;
+    while (config_file.Has_More_Lines()) {
+      std::string line = config_file.Get_Line();
+      cArray<std::string> pair = Parse_Sausage_Text(line, "=");
+      if (pair.Count() == 2) {
+        if (pair[0] == "letter-w") {
+          this->letter_w = Text_To_Number(pair[1]);
+        }
+        else if (pair[0] == "letter-h") {
+          this->letter_h = Text_To_Number(pair[1]);
+        }
+        else if (pair[0] == "width") {
+          this->width = Text_To_Number(pair[1]);
+        }
+        else if (pair[0] == "height") {
+          this->height = Text_To_Number(pair[1]);
+        }
+        else if (pair[0] == "interrupt") {
+          this->interrupt_pointer = Text_To_Number(pair[1]);
+        }
+        else if (pair[0] == "memory") {
+          memory_size = Text_To_Number(pair[1]);
+        }
+        else if (pair[0] == "program") {
+          this->pc = Text_To_Number(pair[1]);
+        }
+        else if (pair[0] == "stack") {
+          this->sp = Text_To_Number(pair[1]);
+        }
+        else if (pair[0] == "checkpoint") {
+          // Checkpoints that come due while threads are running wait for the
+          // next run after they are joined.
+          this->checkpoint_interval = Text_To_Number(pair[1]);
+        }
+        else if (pair[0] == "compact") {
+          this->compact_interval = Text_To_Number(pair[1]);
+        }
+        else {
+          throw cError("Invalid configuration property " + pair[0] + ".");
+        }
+      }
+      // Anything that is not a pair is a comment.
+    }
+    metrics.Add_Time(eMETRIC_CONFIG_TIME, start);
+    // Apply settings.
+    this->memory = new cMemory(memory_size);
+    this->start = this->Get_Registers();
+#ifdef CODER_PROFILE
+    this->profiler = new cProfiler(memory_size, this->pc);
+#endif
+  }
+
+  /**
+   * Creates a hardware thread. The thread shares memory and I/O with its
+   * parent but has its own program counter and stack.
+   * @param parent The simulator that spawned the thread.
+   * @param pc Where the thread starts running.
+   * @param sp The start of the thread's stack.
+   */
+  cSimulator::cSimulator(cSimulator* parent, int pc, int sp) {
+    this->io = parent->io;
+    this->pc = pc;
+    this->sp = sp;
+    this->status = eSTATUS_RUNNING;
+    this->memory = parent->memory;
+    this->interrupt_pointer = parent->interrupt_pointer;
+    this->width = parent->width;
+    this->height = parent->height;
+    this->letter_w = parent->letter_w;
+    this->letter_h = parent->letter_h;
+    this->spinning = false;
+    this->spin_writes = 0;
+    this->spin_sp = 0;
+    this->spin_count = 0;
+    this->spin_input = false;
+    this->yielding = false;
+    this->debugging = false; // Breakpoints are only taken on the main thread.
+    this->breaking = false;
+    this->instructions = 0;
+    this->parent = parent;
+    this->stopping = false;
+    this->checkpoint_interval = 0;
+    this->compact_interval = 0;
+    this->delta_count = 0;
+    this->generation = 0;
+    this->next_checkpoint = 0;
+    this->trace = NULL; // Only the main thread is traced.
+#ifdef CODER_PROFILE
+    this->profiler = NULL; // Only the main thread is profiled.
+#endif
+  }
+
+  /**
+   * Frees the simulator. Threads that are still running are stopped first.
+   */
+  cSimulator::~cSimulator() {
+    this->Stop_Threads();
+    if (this->memory && !this->parent) { // Threads share their parent's memory.
+      delete this->memory;
+    }
+    if (this->trace) {
+      delete this->trace;
+    }
+#ifdef CODER_PROFILE
+    if (this->profiler) {
+      delete this->profiler;
+    }
+#endif
+  }
+
+  /**
+   * Loads a program to the memory.
+   * @param name The name of the program to load.
+   * @throws An error if the program could not be loaded.
    */
   void cSimulator::Load_Program(std::string name) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
     cFile prgm_file(name + ".prgm");
     prgm_file.Read();
     int prgm_count = 0;
@@ -248,340 +1288,3786 @@ namespace Codeloader {
       // std::cout << "code=" << code << ", prgm_count=" << prgm_count << std::endl;
       this->memory->Write_Number(prgm_count++, code);
     }
-    this->status = eSTATUS_RUNNING;
-    std::cout << "Loaded " << prgm_count << " codes into memory." << std::endl;
+    this->status = eSTATUS_RUNNING;
+    this->name = name;
+    this->next_checkpoint = this->instructions + this->checkpoint_interval;
+    metrics.Add_Time(eMETRIC_LOAD_TIME, start);
+    std::cout << "Loaded " << prgm_count << " codes into memory." << std::endl;
+  }
+
+  /**
+   * Saves the program in the memory to a file.
+   * @param name The name of the file.
+   * @param trim True to stop at the last word that is not zero instead of
+   * writing the whole memory.
+   * @throws An error if the program could not be saved.
+   */
+  void cSimulator::Save_Program(std::string name, bool trim) {
+    cFile prgm_file(name + ".prgm");
+    int prgm_count = this->memory->count;
+    while (trim && (prgm_count > 0) && (this->memory->memory[prgm_count - 1] == 0)) {
+      prgm_count--; // Memory starts out clear so trailing zeros are not needed.
+    }
+    for (int mem_index = 0; mem_index < prgm_count; mem_index++) {
+      prgm_file.Add(this->memory->Read_Number(mem_index));
+    }
+    prgm_file.Write();
+  }
+
+  /**
+   * Saves the whole machine to a binary state file. The registers are
+   * written first and then every page that is not clear.
+   * @param name The name of the state file.
+   * @throws An error if the state could not be saved.
+   */
+  void cSimulator::Save_State(std::string name) {
+    this->Check_Threads();
+    this->Write_State(name + ".state", false);
+  }
+
+  /**
+   * Loads the whole machine from a binary state file.
+   * @param name The name of the state file.
+   * @throws An error if the state could not be loaded.
+   */
+  void cSimulator::Load_State(std::string name) {
+    this->Check_Threads();
+    this->Read_State(name + ".state", false);
+  }
+
+  /**
+   * Writes the registers and memory pages to a file. A full state has every
+   * page that is not clear. A delta has only the pages that are dirty. The
+   * file is written next to the old one and then renamed over it so a crash
+   * never leaves a half written state behind.
+   * @param name The name of the file.
+   * @param delta True if only dirty pages are written.
+   * @throws An error if the file could not be written.
+   */
+  void cSimulator::Write_State(std::string name, bool delta) {
+    std::string temp_name = name + ".tmp";
+    std::ofstream state_file(temp_name, std::ios::binary);
+    if (!state_file) {
+      throw cError("Could not save state " + name + ".");
+    }
+    int header[] = {
+      STATE_VERSION,
+      this->generation,
+      this->pc,
+      this->sp,
+      this->status,
+      this->interrupt_pointer,
+      this->memory->count
+    };
+    state_file.write(delta ? "CDLT" : "CSTA", 4);
+    state_file.write((char*)header, sizeof(header));
+    int page_count = delta ? this->memory->dirty_count : this->memory->page_count;
+    for (int page_index = 0; page_index < page_count; page_index++) {
+      int page = delta ? this->memory->dirty_list[page_index] : page_index;
+      if (delta || !this->memory->Is_Page_Clear(page)) {
+        int start = page * MEMORY_PAGE_SIZE;
+        int size = std::min(MEMORY_PAGE_SIZE, this->memory->count - start);
+        state_file.write((char*)&page, sizeof(int));
+        state_file.write((char*)(this->memory->memory + start), size * sizeof(int));
+      }
+    }
+    int end = -1;
+    state_file.write((char*)&end, sizeof(int));
+    state_file.close();
+    if (!state_file) {
+      std::remove(temp_name.c_str());
+      throw cError("Could not save state " + name + ".");
+    }
+#ifdef _WIN32
+    std::remove(name.c_str()); // Windows will not rename over a file.
+#endif
+    if (std::rename(temp_name.c_str(), name.c_str()) != 0) {
+      throw cError("Could not save state " + name + ".");
+    }
+  }
+
+  /**
+   * Reads the registers and memory pages from a file. A full state replaces
+   * all of memory and sets the generation. A delta is applied on top of what
+   * is already there but only if it has the same generation. The pages are
+   * read in full before anything is changed so a bad file leaves the
+   * machine as it was.
+   * @param name The name of the file.
+   * @param delta True if the file is a delta.
+   * @return True if the state was applied, false if the delta is left over
+   * from an older chain.
+   * @throws An error if the file could not be read.
+   */
+  bool cSimulator::Read_State(std::string name, bool delta) {
+    std::ifstream state_file(name, std::ios::binary);
+    if (!state_file) {
+      throw cError("Could not load state " + name + ".");
+    }
+    char magic[4] = { 0, 0, 0, 0 };
+    int header[7];
+    state_file.read(magic, 4);
+    state_file.read((char*)header, sizeof(header));
+    if (!state_file || (std::memcmp(magic, delta ? "CDLT" : "CSTA", 4) != 0) || (header[0] != STATE_VERSION)) {
+      throw cError(name + " is not a valid state file.");
+    }
+    if (delta && (header[1] != this->generation)) {
+      return false;
+    }
+    int memory_size = header[6]; // State decides the memory size.
+    if ((memory_size <= 0) || (memory_size > STATE_MEMORY_MAX)) {
+      throw cError("State " + name + " has an invalid memory size of " + Number_To_Text(memory_size) + ".");
+    }
+    if (delta && (memory_size != this->memory->count)) {
+      throw cError("Delta " + name + " does not match the memory size.");
+    }
+    int page_count = (memory_size + MEMORY_PAGE_SIZE - 1) / MEMORY_PAGE_SIZE;
+    std::vector<int> pages;
+    std::vector<int> data;
+    cMemory* memory = this->memory;
+    try {
+      int page = 0;
+      state_file.read((char*)&page, sizeof(int));
+      while (state_file && (page != -1)) {
+        if ((page < 0) || (page >= page_count)) {
+          throw cError("Invalid page " + Number_To_Text(page) + " in state " + name + ".");
+        }
+        int size = std::min(MEMORY_PAGE_SIZE, memory_size - (page * MEMORY_PAGE_SIZE));
+        int offset = (int)data.size();
+        pages.push_back(page);
+        data.resize(offset + size);
+        state_file.read((char*)(data.data() + offset), size * sizeof(int));
+        state_file.read((char*)&page, sizeof(int));
+      }
+      if (!state_file) {
+        throw cError("State " + name + " is cut short.");
+      }
+      if (memory_size != memory->count) {
+        memory = new cMemory(memory_size);
+      }
+    }
+    catch (std::bad_alloc& error) {
+      throw cError("Not enough memory to load state " + name + ".");
+    }
+    // Everything is read so swap it in.
+    if (memory != this->memory) {
+      if (this->memory->tracking) {
+        memory->Track_Dirty();
+      }
+      delete this->memory;
+      this->memory = memory;
+    }
+    else if (!delta) {
+      memory->Clear();
+    }
+    int offset = 0;
+    int page_total = (int)pages.size();
+    for (int page_index = 0; page_index < page_total; page_index++) {
+      int page = pages[page_index];
+      int start = page * MEMORY_PAGE_SIZE;
+      int size = std::min(MEMORY_PAGE_SIZE, memory_size - start);
+      if (memory->page_traps[page]) {
+        memory->Trap_Write(page);
+      }
+      std::memcpy(memory->memory + start, data.data() + offset, size * sizeof(int));
+      offset += size;
+    }
+    this->generation = header[1];
+    this->pc = header[2];
+    this->sp = header[3];
+    this->status = header[4];
+    this->interrupt_pointer = header[5];
+    this->spinning = false;
+    this->spin_count = 0;
+    return true;
+  }
+
+  /**
+   * Reads the generation of a full state without loading it.
+   * @param name The name of the file.
+   * @return The generation or zero if there is no valid state.
+   */
+  int cSimulator::Read_Generation(std::string name) {
+    std::ifstream state_file(name, std::ios::binary);
+    char magic[4] = { 0, 0, 0, 0 };
+    int header[2] = { 0, 0 };
+    state_file.read(magic, 4);
+    state_file.read((char*)header, sizeof(header));
+    if (!state_file || (std::memcmp(magic, "CSTA", 4) != 0) || (header[0] != STATE_VERSION)) {
+      return 0;
+    }
+    return header[1];
+  }
+
+  /**
+   * Saves a checkpoint. The first checkpoint is a full state and the ones
+   * after it are deltas with the pages written since the last checkpoint.
+   * After compact-interval deltas the chain is compacted into a new full
+   * state. Each full state starts a new generation so deltas from the old
+   * chain are ignored even if a crash leaves them behind.
+   * @throws An error if the checkpoint could not be saved.
+   */
+  void cSimulator::Save_Checkpoint() {
+    this->Check_Threads();
+    if (!this->memory->tracking) {
+      this->memory->Track_Dirty();
+    }
+    if ((this->delta_count == 0) || (this->delta_count > this->compact_interval)) {
+      if (this->delta_count == 0) { // Follow on from whatever chain is on disk.
+        this->generation = std::max(this->generation, this->Read_Generation(this->name + ".state"));
+      }
+      this->generation++;
+      this->Write_State(this->name + ".state", false);
+      // Remove the old chain.
+      int delta_index = 1;
+      while (std::remove((this->name + "." + Number_To_Text(delta_index) + ".delta").c_str()) == 0) {
+        delta_index++;
+      }
+      this->delta_count = 1;
+    }
+    else {
+      this->Write_State(this->name + "." + Number_To_Text(this->delta_count) + ".delta", true);
+      this->delta_count++;
+    }
+    this->memory->Clear_Dirty();
+    this->next_checkpoint = this->instructions + this->checkpoint_interval;
+  }
+
+  /**
+   * Loads the last checkpoint by loading the full state and then applying
+   * each delta in the chain.
+   * @param name The name of the program.
+   * @throws An error if the checkpoint could not be loaded.
+   */
+  void cSimulator::Load_Checkpoint(std::string name) {
+    this->Check_Threads();
+    this->name = name;
+    this->Read_State(name + ".state", false);
+    int delta_index = 1;
+    while (true) {
+      std::string delta_name = name + "." + Number_To_Text(delta_index) + ".delta";
+      std::ifstream delta_file(delta_name, std::ios::binary);
+      if (!delta_file) {
+        break; // End of the chain.
+      }
+      delta_file.close();
+      if (!this->Read_State(delta_name, true)) {
+        break; // Left over from an older chain.
+      }
+      delta_index++;
+    }
+    // Carry on the chain from here.
+    this->memory->Track_Dirty();
+    this->delta_count = delta_index;
+    this->next_checkpoint = this->instructions + this->checkpoint_interval;
+  }
+
+  /**
+   * Takes an in-process snapshot of the machine. Memory is copied on write
+   * so taking the snapshot is cheap.
+   * @throws An error if threads are running.
+   */
+  void cSimulator::Take_Snapshot() {
+    this->Check_Threads();
+    this->snapshot = this->Get_Registers();
+    this->memory->Take_Snapshot();
+  }
+
+  /**
+   * Rolls the machine back to the last snapshot.
+   * @throws An error if there is no snapshot or threads are running.
+   */
+  void cSimulator::Restore_Snapshot() {
+    this->Check_Threads();
+    this->memory->Restore_Snapshot();
+    this->Set_Registers(this->snapshot);
+  }
+
+  /**
+   * Gets the registers of the machine.
+   * @return The registers.
+   */
+  sRegisters cSimulator::Get_Registers() {
+    sRegisters registers = {
+      this->pc,
+      this->sp,
+      this->status,
+      this->interrupt_pointer
+    };
+    return registers;
+  }
+
+  /**
+   * Sets the registers of the machine.
+   * @param registers The registers.
+   */
+  void cSimulator::Set_Registers(sRegisters registers) {
+    this->pc = registers.pc;
+    this->sp = registers.sp;
+    this->status = registers.status;
+    this->interrupt_pointer = registers.interrupt_pointer;
+    this->spinning = false;
+    this->spin_count = 0;
+  }
+
+  /**
+   * Determines if any thread has not been joined.
+   * @return True if a thread is still running, false otherwise.
+   */
+  bool cSimulator::Has_Threads() {
+    int thread_count = this->runners.Count();
+    for (int thread_index = 0; thread_index < thread_count; thread_index++) {
+      if (this->runners[thread_index]) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /**
+   * Makes sure no threads are running. The machine state is only complete
+   * when all threads have been joined.
+   * @throws An error if a thread is still running.
+   */
+  void cSimulator::Check_Threads() {
+    int thread_count = this->runners.Count();
+    for (int thread_index = 0; thread_index < thread_count; thread_index++) {
+      if (this->runners[thread_index]) {
+        throw cError("Thread " + Number_To_Text(thread_index + 1) + " is still running.");
+      }
+    }
+  }
+
+  /**
+   * Stops every thread that was not joined and frees all threads. Thread
+   * numbers start over at one.
+   */
+  void cSimulator::Stop_Threads() {
+    while (this->threads.Count() > 0) {
+      cSimulator* thread = this->threads.Pop();
+      std::thread* runner = this->runners.Pop();
+      if (runner) {
+        thread->stopping = true;
+        this->memory->Wake_Sleepers();
+        runner->join();
+        delete runner;
+      }
+      delete thread;
+    }
+  }
+
+  /**
+   * Steps through a single instruction execution.
+   * @throws An error if the instruction is invalid.
+   */
+  void cSimulator::Step() {
+    int instruction = this->memory->Read_Number(this->pc++);
+    // std::cout << "instruction=" << instruction << ", pc=" << (this->pc - 1) << std::endl;
+#ifdef CODER_PROFILE
+    int start = this->pc - 1;
+    if (this->profiler) {
+      this->profiler->Count(start, instruction);
+    }
+#endif
+    switch (instruction) {
+      case eINST_COPY: {
+        int value = this->Fetch_From_Address();
+        this->Write_To_Address(value);
+        break;
+      }
+      case eINST_ADD: {
+        int left = this->Fetch_From_Address();
+        int right = this->Fetch_From_Address();
+        this->Write_To_Address((int)((unsigned int)left + (unsigned int)right)); // Wraps around.
+        break;
+      }
+      case eINST_SUB: {
+        int left = this->Fetch_From_Address();
+        int right = this->Fetch_From_Address();
+        this->Write_To_Address((int)((unsigned int)left - (unsigned int)right)); // Wraps around.
+        break;
+      }
+      case eINST_MUL: {
+        int left = this->Fetch_From_Address();
+        int right = this->Fetch_From_Address();
+        this->Write_To_Address((int)((unsigned int)left * (unsigned int)right)); // Wraps around.
+        break;
+      }
+      case eINST_DIV: {
+        int left = this->Fetch_From_Address();
+        int right = this->Fetch_From_Address();
+        if (right == 0) {
+          this->Write_To_Address(left); // Do not divide!
+        }
+        else if (right == -1) {
+          this->Write_To_Address((int)(0u - (unsigned int)left)); // The smallest number would overflow.
+        }
+        else {
+          this->Write_To_Address(left / right);
+        }
+        break;
+      }
+      case eINST_TEST: {
+        bool result = this->Eval_Test();
+        int passed_addr = this->Fetch_Number();
+        int failed_addr = this->Fetch_Number();
+        // std::cout << "passed=" << passed_addr << ", failed=" << failed_addr << std::endl;
+        // if (failed_addr == 1) {
+        //   std::cout << "Yes! It is really 1!" << std::endl;
+        // }
+        int address = result ? passed_addr : failed_addr;
+        if (address != TAKE_NO_JUMP) { // Jumps do not need to be taken.
+          if (address < this->pc) {
+            this->Watch_Spin(address);
+          }
+#ifdef CODER_PROFILE
+          if (this->profiler) {
+            this->profiler->Jump(start, address);
+          }
+#endif
+          this->pc = address;
+        }
+        break;
+      }
+      case eINST_JUMP: {
+        int address = this->Fetch_Number();
+        if (address < this->pc) {
+          this->Watch_Spin(address);
+        }
+#ifdef CODER_PROFILE
+        if (this->profiler) {
+          this->profiler->Jump(start, address);
+        }
+#endif
+        this->pc = address;
+        break;
+      }
+      case eINST_JSUB: {
+        int address = this->Fetch_From_Address();
+        // std::cout << "jsub=" << address << std::endl;
+        this->Push(this->pc); // Push the value to the next instruction after the JSUB.
+#ifdef CODER_PROFILE
+        if (this->profiler) {
+          this->profiler->Call(start, address);
+        }
+#endif
+        this->pc = address;
+        break;
+      }
+      case eINST_PUSH: {
+        int value = this->Fetch_From_Address();
+        this->Push(value);
+        break;
+      }
+      case eINST_POP: {
+        int value = this->Pop();
+        this->Write_To_Address(value);
+        break;
+      }
+      case eINST_RETURN: {
+        int address = this->Pop(); // Get address to return to.
+#ifdef CODER_PROFILE
+        if (this->profiler) {
+          this->profiler->Return(start, address);
+        }
+#endif
+        this->pc = address;
+        break;
+      }
+      case eINST_AND: {
+        int left = this->Fetch_From_Address();
+        int right = this->Fetch_From_Address();
+        this->Write_To_Address(left & right);
+        break;
+      }
+      case eINST_OR: {
+        int left = this->Fetch_From_Address();
+        int right = this->Fetch_From_Address();
+        this->Write_To_Address(left | right);
+        break;
+      }
+      case eINST_HALT: {
+        this->status = eSTATUS_IDLE;
+        break;
+      }
+      case eINST_INTERRUPT: {
+        int interrupt = this->Fetch_Number();
+        int writes = this->memory->writes;
+        this->Process_Interrupt(interrupt);
+        if ((interrupt == eINTERRUPT_INPUT) && (this->memory->writes == writes)) {
+          this->spin_input = true; // A poll with no new key changes nothing.
+        }
+        else {
+          this->spin_count = 0; // Interrupts have side effects so this is not a spin.
+          this->spin_input = false;
+        }
+        break;
+      }
+      case eINST_SPAWN: {
+        int address = this->Fetch_From_Address();
+        int stack = this->Fetch_From_Address();
+        int thread = this->Spawn_Thread(address, stack);
+        this->Write_To_Address(thread);
+        break;
+      }
+      case eINST_JOIN: {
+        int thread = this->Fetch_From_Address();
+        this->Join_Thread(thread);
+        break;
+      }
+      case eINST_CAS: {
+        int address = this->Fetch_From_Address();
+        int expected = this->Fetch_From_Address();
+        int value = this->Fetch_From_Address();
+        this->Write_To_Address(this->memory->Compare_And_Swap(address, expected, value));
+        break;
+      }
+      case eINST_FETCH_ADD: {
+        int address = this->Fetch_From_Address();
+        int amount = this->Fetch_From_Address();
+        this->Write_To_Address(this->memory->Fetch_And_Add(address, amount));
+        break;
+      }
+      case eINST_FILL: {
+        int address = this->Fetch_From_Address();
+        int value = this->Fetch_From_Address();
+        int count = this->Fetch_From_Address();
+        this->memory->Fill(address, value, count);
+        break;
+      }
+      case eINST_MOVE: {
+        int source = this->Fetch_From_Address();
+        int destination = this->Fetch_From_Address();
+        int count = this->Fetch_From_Address();
+        this->memory->Move(source, destination, count);
+        break;
+      }
+      case eINST_COMPARE: {
+        int left = this->Fetch_From_Address();
+        int right = this->Fetch_From_Address();
+        int count = this->Fetch_From_Address();
+        this->Write_To_Address(this->memory->Compare(left, right, count));
+        break;
+      }
+      case eINST_VADD: {
+        this->Vector(eINST_ADD, false);
+        break;
+      }
+      case eINST_VSUB: {
+        this->Vector(eINST_SUB, false);
+        break;
+      }
+      case eINST_VMUL: {
+        this->Vector(eINST_MUL, false);
+        break;
+      }
+      case eINST_VAND: {
+        this->Vector(eINST_AND, false);
+        break;
+      }
+      case eINST_VOR: {
+        this->Vector(eINST_OR, false);
+        break;
+      }
+      case eINST_VADD_SCALAR: {
+        this->Vector(eINST_ADD, true);
+        break;
+      }
+      case eINST_VSUB_SCALAR: {
+        this->Vector(eINST_SUB, true);
+        break;
+      }
+      case eINST_VMUL_SCALAR: {
+        this->Vector(eINST_MUL, true);
+        break;
+      }
+      case eINST_VAND_SCALAR: {
+        this->Vector(eINST_AND, true);
+        break;
+      }
+      case eINST_VOR_SCALAR: {
+        this->Vector(eINST_OR, true);
+        break;
+      }
+      case eINST_MOD: {
+        int left = this->Fetch_From_Address();
+        int right = this->Fetch_From_Address();
+        this->Write_To_Address(Modulo(left, right));
+        break;
+      }
+      case eINST_XOR: {
+        int left = this->Fetch_From_Address();
+        int right = this->Fetch_From_Address();
+        this->Write_To_Address(left ^ right);
+        break;
+      }
+      case eINST_SHL: {
+        int value = this->Fetch_From_Address();
+        int count = this->Fetch_From_Address();
+        this->Write_To_Address(Shift_Left(value, count));
+        break;
+      }
+      case eINST_SHR: {
+        int value = this->Fetch_From_Address();
+        int count = this->Fetch_From_Address();
+        this->Write_To_Address(Shift_Right(value, count));
+        break;
+      }
+      case eINST_NOT: {
+        int value = this->Fetch_From_Address();
+        this->Write_To_Address(~value);
+        break;
+      }
+      case eINST_MAC: {
+        int left = this->Fetch_From_Address();
+        int right = this->Fetch_From_Address();
+        int total = this->Peek_From_Address(); // The result is added to.
+        this->Write_To_Address((int)((unsigned int)total + (unsigned int)left * (unsigned int)right));
+        break;
+      }
+      case eINST_TRAP: {
+        if (!this->debugging) {
+          this->status = eSTATUS_ERROR;
+          throw cError("Breakpoint hit outside of the debugger at " + Number_To_Text(this->pc - 1) + ".");
+        }
+        this->pc--; // Stay on the breakpoint so the real instruction runs next.
+        this->breaking = true;
+        this->yielding = true;
+        break;
+      }
+      default: {
+        this->status = eSTATUS_ERROR;
+        throw cError("Invalid instruction at " + Number_To_Text(this->pc) + ": " + Number_To_Text(instruction));
+      }
+    }
+  }
+
+  /**
+   * Runs the simulator for a certain amount of time before it gives up control.
+   * @param timeout The amount of time to run the simulator in milliseconds.
+   */
+  void cSimulator::Run(int timeout) {
+    if (this->spinning) {
+      if (this->memory->writes == this->spin_writes) {
+        // Nothing can break the loop so give the time back to the host. A
+        // loop that polls input is let go to poll again next time.
+        std::this_thread::sleep_for(std::chrono::milliseconds(timeout));
+        if (this->spin_input) {
+          this->spinning = false;
+          this->spin_count = 0;
+        }
+        return;
+      }
+      // Memory was written from outside so the loop may exit now.
+      this->spinning = false;
+      this->spin_count = 0;
+    }
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+    long long first = this->instructions;
+    int countdown = 0;
+    while ((this->status == eSTATUS_RUNNING) && !this->spinning) {
+      // The clock costs more than an instruction so only look at it once in
+      // a while. The overshoot shows what that costs in lateness.
+      if (countdown == 0) {
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (now >= end) {
+          long long overshoot = (long long)std::chrono::duration_cast<std::chrono::nanoseconds>(now - end).count();
+          metrics.Add(eMETRIC_RUN_OVERSHOOT, overshoot);
+          metrics.Raise(eMETRIC_RUN_OVERSHOOT_MAX, overshoot);
+          break; // Time is up, break out!
+        }
+        countdown = RUN_CLOCK_CHECK;
+      }
+      countdown--;
+      this->Step();
+      this->instructions++;
+    }
+    metrics.Add(eMETRIC_INSTRUCTIONS, this->instructions - first);
+    metrics.Add(eMETRIC_RUNS, 1);
+    if ((this->checkpoint_interval > 0) && (this->instructions >= this->next_checkpoint) && !this->Has_Threads()) {
+      this->Save_Checkpoint(); // Tried again next run if threads are up.
+    }
+    this->Check_Trace();
+  }
+
+  /**
+   * Runs the simulator for a number of instructions. The slice ends early if
+   * the program stops, starts spinning, or waits on input or a timer.
+   * @param budget The maximum number of instructions to execute.
+   * @return The number of instructions executed.
+   * @throws An error if an instruction fails.
+   */
+  int cSimulator::Run_Slice(int budget) {
+    int count = 0;
+    this->yielding = false;
+    while ((count < budget) && (this->status == eSTATUS_RUNNING) && !this->spinning && !this->yielding) {
+      this->Step();
+      this->instructions++; // Kept exact for traces.
+      count++;
+    }
+    metrics.Add(eMETRIC_INSTRUCTIONS, count);
+    this->Check_Trace();
+    return count;
+  }
+
+  /**
+   * Records a trace checkpoint if one is due. Checkpoints are skipped while
+   * threads are running since their timing cannot be replayed.
+   */
+  void cSimulator::Check_Trace() {
+    if (this->trace && this->trace->recording && (this->instructions >= this->trace->next_checkpoint) && !this->Has_Threads()) {
+      this->trace->Record_Checkpoint(this);
+    }
+  }
+
+  /**
+   * Fetches a number from the memory.
+   * @return The fetched number.
+   * @throws An error if the number could not be fetched.
+   */
+  int cSimulator::Fetch_Number() {
+    return this->memory->Read_Number(this->pc++);
+  }
+
+  /**
+   * Puts a number on the memory.
+   * @param number The number to put.
+   * @throws An error if there is an invalid memory access.
+   */
+  void cSimulator::Put_Number(int number) {
+    this->memory->Write_Number(this->pc++, number);
+  }
+
+  /**
+   * Fetches a number from an address.
+   * @return The fetched number.
+   * @throws An error if the number could not be fetched.
+   */
+  int cSimulator::Fetch_From_Address() {
+    int number = 0;
+    int addr_mode = this->memory->Read_Number(this->pc++);
+    int address = this->memory->Read_Number(this->pc++);
+    switch (addr_mode) {
+      case eADDRESS_VALUE: {
+        number = address; // Address is the value.
+        break;
+      }
+      case eADDRESS_IMMEDIATE: {
+        number = this->memory->Read_Number(address);
+        break;
+      }
+      case eADDRESS_POINTER: {
+        int pointer = this->memory->Read_Number(address);
+        number = this->memory->Read_Number(pointer);
+        break;
+      }
+      default: {
+        this->status = eSTATUS_ERROR;
+        throw cError("Invalid address mode " + Number_To_Text(addr_mode) + " for read.");
+      }
+    }
+    return number;
+  }
+
+  /**
+   * Fetches a number from an address without moving past it. This is used
+   * when the same address is read and then written.
+   * @return The fetched number.
+   * @throws An error if the number could not be fetched.
+   */
+  int cSimulator::Peek_From_Address() {
+    int pc = this->pc;
+    int number = this->Fetch_From_Address();
+    this->pc = pc;
+    return number;
+  }
+
+  /**
+   * Writes a value to the memory at the given address.
+   * @param value The value to write to memory.
+   * @throws An error if the address mode is invalid. You cannot have a value address mode.
+   */
+  void cSimulator::Write_To_Address(int value) {
+    int addr_mode = this->memory->Read_Number(this->pc++);
+    int address = this->memory->Read_Number(this->pc++);
+    switch (addr_mode) {
+      case eADDRESS_IMMEDIATE: {
+        this->memory->Write_Number(address, value);
+        break;
+      }
+      case eADDRESS_POINTER: {
+        int pointer = this->memory->Read_Number(address);
+        this->memory->Write_Number(pointer, value);
+        break;
+      }
+      default: {
+        this->status = eSTATUS_ERROR;
+        throw cError("Invalid address mode " + Number_To_Text(addr_mode) + " for write.");
+      }
+    }
+  }
+
+  /**
+   * Evaluates a test for the command.
+   * @return True if the test passed, false if it failed.
+   * @throws An error if the test is invalid.
+   */
+  bool cSimulator::Eval_Test() {
+    int left = this->Fetch_From_Address();
+    int test = this->Fetch_Number();
+    int right = this->Fetch_From_Address();
+    bool result = false;
+    // The test reads right to left so > passes when right is bigger. The
+    // numbers are compared directly since a difference could overflow.
+    switch (test) {
+      case eTEST_EQUALS: {
+        result = (right == left);
+        break;
+      }
+      case eTEST_NOT: {
+        result = (right != left);
+        break;
+      }
+      case eTEST_GREATER: {
+        result = (right > left);
+        break;
+      }
+      case eTEST_LESS: {
+        result = (right < left);
+        break;
+      }
+      case eTEST_GREATER_OR_EQUAL: {
+        result = (right >= left);
+        break;
+      }
+      case eTEST_LESS_OR_EQUAL: {
+        result = (right <= left);
+        break;
+      }
+      default: {
+        this->status = eSTATUS_ERROR;
+        throw cError("Invalid test " + Number_To_Text(test) + ".");
+      }
+    }
+    return result;
+  }
+
+  /**
+   * Pushes a value onto the stack.
+   * @param value The value to push onto the stack.
+   * @throws An error if an invalid memory location is accessed.
+   */
+  void cSimulator::Push(int value) {
+    this->memory->Write_Number(this->sp++, value);
+  }
+
+  /**
+   * Pops a value off of the stack.
+   * @return The value from the stack.
+   * @throws An error if an invalid memory location is accessed.
+   */
+  int cSimulator::Pop() {
+    return this->memory->Read_Number(--this->sp);
+  }
+
+  /**
+   * Processes an interrupt.
+   * @param interrupt The interrupt number.
+   * @throws An error if the interrupt is not recognized.
+   */
+  void cSimulator::Process_Interrupt(int interrupt) {
+    std::lock_guard<std::mutex> guard(this->memory->lock); // Threads share the I/O.
+    int pointer = this->memory->Read_Number(this->interrupt_pointer + interrupt);
+    switch (interrupt) {
+      case eINTERRUPT_INPUT: {
+        int code = 0;
+        if (this->trace && !this->trace->recording) {
+          code = this->trace->Replay_Key(this->instructions);
+        }
+        else {
+          sSignal key = this->io->Read_Key();
+          code = key.code;
+          if (this->trace) {
+            this->trace->Record_Key(this->instructions, code);
+          }
+        }
+        if ((pointer < 0) || (pointer >= this->memory->count) || (this->memory->Read_Number(pointer) != code)) {
+          this->memory->Write_Number(pointer, code); // Write out key.
+        }
+        this->yielding = true;
+        metrics.Add(eMETRIC_INTERRUPT_INPUT, 1);
+        break;
+      }
+      case eINTERRUPT_SCREEN: {
+        this->Draw_Screen(this->memory, pointer);
+        metrics.Add(eMETRIC_INTERRUPT_SCREEN, 1);
+        break;
+      }
+      case eINTERRUPT_TIMEOUT: {
+        int delay = this->memory->Read_Number(pointer);
+        this->io->Timeout(delay);
+        if (this->trace && this->trace->recording) {
+          this->trace->Record_Timer(this->instructions, delay);
+        }
+        else if (this->trace) {
+          this->trace->Replay_Timer(this->instructions, delay);
+        }
+        this->yielding = true;
+        metrics.Add(eMETRIC_INTERRUPT_TIMEOUT, 1);
+        break;
+      }
+      default: {
+        throw cError("Interrupt " + Number_To_Text(interrupt) + " is not defined.");
+      }
+    }
+  }
+
+  /**
+   * Draws the character screen to the display.
+   * @param memory The memory where the screen is at.
+   * @param address The address of the screen.
+   */
+  void cSimulator::Draw_Screen(Codeloader::cMemory* memory, int address) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    int grid_w = this->width / this->letter_w;
+    int grid_h = this->height / this->letter_h;
+    this->io->Color(255, 255, 255); // Color screen to white.
+    for (int y = 0; y < grid_h; y++) {
+      for (int x = 0; x < grid_w; x++) {
+        int letter = memory->Read_Number(address + (y * grid_w) + x);
+        char buffer[2] = { (char)letter, 0 };
+        this->io->Output_Text(buffer, x * this->letter_w, y * this->letter_h, 0, 0, 255);
+      }
+    }
+    // Draw screen to display.
+    this->io->Refresh();
+    metrics.Add(eMETRIC_CELLS_DRAWN, grid_w * grid_h);
+    metrics.Add_Time(eMETRIC_DRAW_TIME, start);
+  }
+
+  /**
+   * Puts the simulator back the way the config left it so it can be used
+   * again without reading the config. Threads the last program left running
+   * are stopped first so they cannot write into the next one.
+   */
+  void cSimulator::Reset() {
+    this->Stop_Threads();
+    this->memory->Drop_Snapshot();
+    this->memory->Clear();
+    this->Set_Registers(this->start);
+    this->instructions = 0;
+    this->yielding = false;
+  }
+
+  /**
+   * Gets the character screen as text with one line per row.
+   * @return The screen text.
+   * @throws An error if the screen is outside the memory.
+   */
+  std::string cSimulator::Get_Screen_Text() {
+    int address = this->memory->Read_Number(this->interrupt_pointer + eINTERRUPT_SCREEN);
+    int grid_w = this->width / this->letter_w;
+    int grid_h = this->height / this->letter_h;
+    std::string text = "";
+    for (int y = 0; y < grid_h; y++) {
+      for (int x = 0; x < grid_w; x++) {
+        int letter = this->memory->Read_Number(address + (y * grid_w) + x);
+        text += ((letter >= ' ') && (letter <= '~')) ? (char)letter : ' ';
+      }
+      text += '\n';
+    }
+    return text;
+  }
+
+  /**
+   * Runs a vector instruction.
+   * @param operation The scalar instruction to apply to each element.
+   * @param scalar True if the right operand is a value instead of a list.
+   * @throws An error if any list is outside the memory.
+   */
+  void cSimulator::Vector(int operation, bool scalar) {
+    int left = this->Fetch_From_Address();
+    int right = this->Fetch_From_Address();
+    int destination = this->Fetch_From_Address();
+    int count = this->Fetch_From_Address();
+    this->memory->Vector(operation, left, right, destination, count, scalar);
+  }
+
+  /**
+   * Watches backward branches for loops that cannot make progress. If the
+   * program lands on the same branch target twice with no memory writes,
+   * stack changes, or interrupts in between then the machine is in exactly
+   * the same state and will loop forever. An input poll that found no new
+   * key does not count as an interrupt here, so a loop that waits on input
+   * is caught too and marked with spin_input. Only a key can break that
+   * loop, so the runners let it poll again after giving their time back
+   * and the host, which has no keyboard, drops it. Timers still end the
+   * watch since a loop that waits on them is already throttled.
+   * @param address The address of the branch target.
+   */
+  void cSimulator::Watch_Spin(int address) {
+    if ((this->memory->writes != this->spin_writes) || (this->sp != this->spin_sp)) {
+      // Something changed so start watching from here.
+      this->spin_writes = this->memory->writes;
+      this->spin_sp = this->sp;
+      this->spin_count = 0;
+      this->spin_input = false;
+    }
+    for (int target_index = 0; target_index < this->spin_count; target_index++) {
+      if (this->spin_targets[target_index] == address) {
+        this->spinning = true;
+        return;
+      }
+    }
+    if (this->spin_count == SPIN_TARGET_MAX) {
+      this->spin_count = 0; // Loop is too big to watch so start over.
+    }
+    this->spin_targets[this->spin_count++] = address;
+  }
+
+  // **************************************************************************
+  // Thread Implementation
+  //
+  // Memory Model
+  //
+  // All threads share one memory. Each thread has its own pc and sp so each
+  // thread needs its own stack region. Every read and write of a single
+  // number is atomic but not ordered, so a thread never sees half a number
+  // but may see another thread's writes late until they synchronize.
+  // Threads synchronize in two ways:
+  //
+  // 1. The cas and fadd instructions are atomic read-modify-writes. They are
+  //    ordered with each other and everything a thread wrote before one is
+  //    visible to a thread that does one after it on the same memory.
+  // 2. The join instruction waits for the thread to halt. Everything the
+  //    thread wrote is visible after the join.
+  //
+  // The block and vector instructions copy whole ranges at once and are not
+  // atomic. Threads must not run them on memory another thread is using
+  // until they synchronize. Interrupts are serialized so only one thread
+  // uses the I/O at a time.
+  //
+  // The order in which threads get to a cas or fadd is up to the host, so a
+  // program whose result depends on that order can give different results
+  // from run to run.
+  // **************************************************************************
+
+  /**
+   * Spawns a hardware thread on its own host thread. The number of a thread
+   * that was joined is given to the next thread spawned.
+   * @param address Where the thread starts running.
+   * @param stack The start of the thread's stack.
+   * @return The thread number, starting at one.
+   */
+  int cSimulator::Spawn_Thread(int address, int stack) {
+    cSimulator* thread = new cSimulator(this, address, stack);
+    int thread_count = this->threads.Count();
+    for (int thread_index = 0; thread_index < thread_count; thread_index++) {
+      if (!this->threads[thread_index]) {
+        this->threads[thread_index] = thread;
+        this->runners[thread_index] = new std::thread(&cSimulator::Run_Thread, thread);
+        return thread_index + 1;
+      }
+    }
+    this->threads.Push(thread);
+    this->runners.Push(new std::thread(&cSimulator::Run_Thread, thread));
+    return this->threads.Count();
+  }
+
+  /**
+   * Waits for a thread to halt and frees it.
+   * @param thread The thread number.
+   * @throws An error if the thread number is invalid or the thread failed.
+   */
+  void cSimulator::Join_Thread(int thread) {
+    if ((thread < 1) || (thread > this->threads.Count()) || !this->threads[thread - 1]) {
+      this->status = eSTATUS_ERROR;
+      throw cError("Invalid thread " + Number_To_Text(thread) + ".");
+    }
+    int thread_index = thread - 1;
+    this->runners[thread_index]->join();
+    delete this->runners[thread_index];
+    this->runners[thread_index] = NULL;
+    cSimulator* joined = this->threads[thread_index];
+    this->threads[thread_index] = NULL;
+    std::string error = joined->error;
+    bool failed = (joined->status == eSTATUS_ERROR);
+    delete joined;
+    if (failed) {
+      this->status = eSTATUS_ERROR;
+      throw cError("Thread " + Number_To_Text(thread) + " failed: " + error);
+    }
+  }
+
+  /**
+   * Runs a thread until it halts, fails, or is stopped.
+   */
+  void cSimulator::Run_Thread() {
+    try {
+      while ((this->status == eSTATUS_RUNNING) && !this->stopping) {
+        if (this->spinning) {
+          if (this->memory->writes == this->spin_writes) {
+            this->memory->Wait_For_Write(this->spin_writes, this->stopping);
+            if (!this->spin_input) {
+              continue;
+            }
+          }
+          this->spinning = false;
+          this->spin_count = 0;
+        }
+        this->Run_Slice(HOST_SLICE);
+      }
+    }
+    catch (cError error) {
+      this->status = eSTATUS_ERROR;
+      this->error = error.message;
+    }
+  }
+
+  // **************************************************************************
+  // Symbols Implementation
+  // **************************************************************************
+
+  /**
+   * Loads the symbol map written by the assembler. Each line has an address
+   * and a label name.
+   * @param name The name of the program.
+   * @throws An error if the map could not be loaded.
+   */
+  void cSymbols::Load(std::string name) {
+    cFile map_file(name + ".map");
+    map_file.Read();
+    while (map_file.Has_More_Lines()) {
+      std::string line = map_file.Get_Line();
+      cArray<std::string> pair = Parse_Sausage_Text(line, "=");
+      if (pair.Count() == 2) {
+        this->addresses.Push(Text_To_Number(pair[0]));
+        this->names.Push(pair[1]);
+      }
+    }
+  }
+
+  /**
+   * Finds the label that an address falls under. The map is sorted by
+   * address so this is a binary search.
+   * @param address The address.
+   * @return The index of the label or -1 if the address is before any label.
+   */
+  int cSymbols::Find_Label(int address) {
+    int low = 0;
+    int high = this->addresses.Count() - 1;
+    int found = -1;
+    while (low <= high) {
+      int middle = (low + high) / 2;
+      if (this->addresses[middle] <= address) {
+        found = middle;
+        low = middle + 1;
+      }
+      else {
+        high = middle - 1;
+      }
+    }
+    return found;
+  }
+
+  /**
+   * Gets a readable name for an address like Label+3.
+   * @param address The address.
+   * @return The name of the address.
+   */
+  std::string cSymbols::Find_Name(int address) {
+    int label = this->Find_Label(address);
+    if (label == -1) {
+      return Number_To_Text(address);
+    }
+    int offset = address - this->addresses[label];
+    if (offset == 0) {
+      return this->names[label];
+    }
+    return this->names[label] + "+" + Number_To_Text(offset);
+  }
+
+  /**
+   * Finds the address of a label.
+   * @param name The name of the label.
+   * @return The address of the label.
+   * @throws An error if the label does not exist.
+   */
+  int cSymbols::Find_Address(std::string name) {
+    int label_count = this->names.Count();
+    for (int label_index = 0; label_index < label_count; label_index++) {
+      if (this->names[label_index] == name) {
+        return this->addresses[label_index];
+      }
+    }
+    throw cError("Could not find label " + name + ".");
+  }
+
+#ifdef CODER_PROFILE
+  // **************************************************************************
+  // Profiler Implementation
+  // **************************************************************************
+
+  /**
+   * Creates a profiler. The profiler is only built with CODER_PROFILE so
+   * normal builds pay nothing for it.
+   * @param memory_size The number of units in the memory.
+   * @param entry Where the program starts running.
+   */
+  cProfiler::cProfiler(int memory_size, int entry) {
+    this->pc_count = memory_size;
+    this->pc_counts = new long long[memory_size];
+    for (int pc_index = 0; pc_index < memory_size; pc_index++) {
+      this->pc_counts[pc_index] = 0;
+    }
+    sCall_Node root = { -1, entry, 0 };
+    this->calls.push_back(root);
+    this->call = 0;
+  }
+
+  /**
+   * Frees the profiler.
+   */
+  cProfiler::~cProfiler() {
+    delete[] this->pc_counts;
+  }
+
+  /**
+   * Counts an instruction.
+   * @param pc Where the instruction is.
+   * @param instruction The instruction code.
+   */
+  void cProfiler::Count(int pc, int instruction) {
+    this->instruction_counts[instruction]++;
+    if (pc < this->pc_count) {
+      this->pc_counts[pc]++;
+    }
+    this->calls[this->call].count++;
+  }
+
+  /**
+   * Counts a jump that was taken.
+   * @param from Where the jump is.
+   * @param to Where the jump goes.
+   */
+  void cProfiler::Jump(int from, int to) {
+    this->edges[std::make_pair(from, to)]++;
+  }
+
+  /**
+   * Counts a subroutine call and moves down the call stack.
+   * @param from Where the call is.
+   * @param to The subroutine.
+   */
+  void cProfiler::Call(int from, int to) {
+    this->Jump(from, to);
+    this->call_counts[to]++;
+    std::pair<int, int> key = std::make_pair(this->call, to);
+    std::map<std::pair<int, int>, int>::iterator node = this->call_index.find(key);
+    if (node == this->call_index.end()) {
+      sCall_Node child = { this->call, to, 0 };
+      this->calls.push_back(child);
+      this->call_index[key] = this->calls.size() - 1;
+      this->call = this->calls.size() - 1;
+    }
+    else {
+      this->call = node->second;
+    }
+  }
+
+  /**
+   * Counts a return and moves up the call stack.
+   * @param from Where the return is.
+   * @param to Where the return goes.
+   */
+  void cProfiler::Return(int from, int to) {
+    this->Jump(from, to);
+    if (this->calls[this->call].parent != -1) {
+      this->call = this->calls[this->call].parent;
+    }
+  }
+
+  /**
+   * Gets the call stack of a node in collapsed form.
+   * @param symbols The symbols to name the subroutines with.
+   * @param node The node of the call stack.
+   * @return The call stack with frames separated by semicolons.
+   */
+  std::string cProfiler::Get_Stack(cSymbols& symbols, int node) {
+    std::string stack = symbols.Find_Name(this->calls[node].target);
+    int parent = this->calls[node].parent;
+    while (parent != -1) {
+      stack = symbols.Find_Name(this->calls[parent].target) + ";" + stack;
+      parent = this->calls[parent].parent;
+    }
+    return stack;
+  }
+
+  /**
+   * Saves the profile. There is a text report, collapsed stacks for flame
+   * graphs, and a profile of label and edge counts for the assembler.
+   * @param name The name of the program.
+   * @throws An error if the reports could not be saved.
+   */
+  void cProfiler::Save_Report(std::string name) {
+    cSymbols symbols;
+    try {
+      symbols.Load(name);
+    }
+    catch (cError error) {
+      // Without a map everything is reported by address.
+    }
+    std::ofstream report(name + ".prof.txt");
+    std::ofstream folded(name + ".folded");
+    std::ofstream profile(name + ".profile");
+    if (!report || !folded || !profile) {
+      throw cError("Could not save profile for " + name + ".");
+    }
+    report << "Instructions" << std::endl;
+    for (std::map<int, long long>::iterator count = this->instruction_counts.begin(); count != this->instruction_counts.end(); count++) {
+      report << "  " << Get_Instruction_Name(count->first) << " " << count->second << std::endl;
+    }
+    // Add up each label.
+    int label_count = symbols.names.Count();
+    std::vector<long long> label_counts(label_count, 0);
+    std::vector<std::pair<long long, int> > hot_pcs;
+    for (int pc_index = 0; pc_index < this->pc_count; pc_index++) {
+      if (this->pc_counts[pc_index] > 0) {
+        int label = symbols.Find_Label(pc_index);
+        if (label != -1) {
+          label_counts[label] += this->pc_counts[pc_index];
+        }
+        hot_pcs.push_back(std::make_pair(this->pc_counts[pc_index], pc_index));
+      }
+    }
+    report << "Labels" << std::endl;
+    for (int label_index = 0; label_index < label_count; label_index++) {
+      if (label_counts[label_index] > 0) {
+        report << "  " << symbols.names[label_index] << " " << label_counts[label_index] << std::endl;
+        profile << "label " << symbols.names[label_index] << " " << label_counts[label_index] << std::endl;
+      }
+    }
+    std::sort(hot_pcs.rbegin(), hot_pcs.rend());
+    report << "Hot Spots" << std::endl;
+    for (int pc_index = 0; (pc_index < (int)hot_pcs.size()) && (pc_index < 20); pc_index++) {
+      report << "  " << symbols.Find_Name(hot_pcs[pc_index].second) << " " << hot_pcs[pc_index].first << std::endl;
+    }
+    report << "Jumps" << std::endl;
+    for (std::map<std::pair<int, int>, long long>::iterator edge = this->edges.begin(); edge != this->edges.end(); edge++) {
+      std::string from = symbols.Find_Name(edge->first.first);
+      std::string to = symbols.Find_Name(edge->first.second);
+      report << "  " << from << " -> " << to << " " << edge->second << std::endl;
+      int from_label = symbols.Find_Label(edge->first.first);
+      int to_label = symbols.Find_Label(edge->first.second);
+      if ((from_label != -1) && (to_label != -1)) {
+        profile << "edge " << symbols.names[from_label] << " " << symbols.names[to_label] << " " << edge->second << std::endl;
+      }
+    }
+    report << "Subroutines" << std::endl;
+    for (std::map<int, long long>::iterator count = this->call_counts.begin(); count != this->call_counts.end(); count++) {
+      report << "  " << symbols.Find_Name(count->first) << " " << count->second << std::endl;
+    }
+    int call_count = this->calls.size();
+    for (int call_index = 0; call_index < call_count; call_index++) {
+      if (this->calls[call_index].count > 0) {
+        folded << this->Get_Stack(symbols, call_index) << " " << this->calls[call_index].count << std::endl;
+      }
+    }
+  }
+#endif
+
+  // **************************************************************************
+  // Trace Implementation
+  //
+  // A trace only holds what cannot be worked out again: the keys that were
+  // read, the timers that were started, and checkpoints of the machine. Each
+  // event is a type letter, the number of instructions since the last event,
+  // and a value, all packed as variable length numbers. A checkpoint holds
+  // the registers and every page that is not clear.
+  // **************************************************************************
+
+  /**
+   * Opens a trace for recording or replay.
+   * @param name The name of the program.
+   * @param recording True to record, false to replay.
+   * @param interval The number of instructions between checkpoints.
+   * @throws An error if the trace could not be opened.
+   */
+  cTrace::cTrace(std::string name, bool recording, long long interval) {
+    this->name = name;
+    this->recording = recording;
+    this->last_instruction = 0;
+    this->interval = interval;
+    this->next_checkpoint = 0;
+    this->event_index = 0;
+    this->cursor = 0;
+    if (recording) {
+      this->file.open((name + ".trace").c_str(), std::ios::binary);
+      if (!this->file) {
+        throw cError("Could not record trace " + name + ".");
+      }
+    }
+    else {
+      std::ifstream trace_file((name + ".trace").c_str(), std::ios::binary);
+      if (!trace_file) {
+        throw cError("Could not load trace " + name + ".");
+      }
+      this->data.assign(std::istreambuf_iterator<char>(trace_file), std::istreambuf_iterator<char>());
+      // Index the events.
+      long long instruction = 0;
+      while (this->cursor < this->data.size()) {
+        sTrace_Event event;
+        event.type = this->data[this->cursor++];
+        instruction += this->Read_Number();
+        event.instruction = instruction;
+        event.value = 0;
+        event.offset = this->cursor;
+        if (event.type == 'C') {
+          size_t size = this->Read_Number();
+          event.offset = this->cursor;
+          this->cursor += size;
+        }
+        else {
+          event.value = this->Read_Signed();
+        }
+        this->events.push_back(event);
+      }
+      this->cursor = 0;
+    }
+  }
+
+  /**
+   * Closes the trace.
+   */
+  cTrace::~cTrace() {
+    if (this->recording) {
+      this->Flush();
+    }
+  }
+
+  /**
+   * Records an event.
+   * @param type The type of event.
+   * @param instruction The instruction count when it happened.
+   * @param value The value of the event.
+   */
+  void cTrace::Record_Event(char type, long long instruction, int value) {
+    this->data.push_back(type);
+    this->Write_Number(instruction - this->last_instruction);
+    this->Write_Signed(value);
+    this->last_instruction = instruction;
+    if (this->data.size() >= TRACE_BUFFER) {
+      this->Flush();
+    }
+  }
+
+  /**
+   * Records a key that was read.
+   * @param instruction The instruction count.
+   * @param code The key code.
+   */
+  void cTrace::Record_Key(long long instruction, int code) {
+    this->Record_Event('K', instruction, code);
+  }
+
+  /**
+   * Records a timer that was started.
+   * @param instruction The instruction count.
+   * @param delay The timer delay.
+   */
+  void cTrace::Record_Timer(long long instruction, int delay) {
+    this->Record_Event('T', instruction, delay);
+  }
+
+  /**
+   * Records the end of the run.
+   * @param instruction The instruction count. If the run failed this is the
+   * instruction that failed.
+   * @param failed True if the run ended with an error.
+   */
+  void cTrace::Record_End(long long instruction, bool failed) {
+    this->Record_Event('E', instruction, failed ? 1 : 0);
+    this->Flush();
+  }
+
+  /**
+   * Records a checkpoint of the machine.
+   * @param simulator The simulator to checkpoint.
+   */
+  void cTrace::Record_Checkpoint(cSimulator* simulator) {
+    std::vector<unsigned char> events;
+    events.swap(this->data); // Build the checkpoint by itself to get its size.
+    this->Write_Signed(simulator->pc);
+    this->Write_Signed(simulator->sp);
+    this->Write_Signed(simulator->status);
+    this->Write_Signed(simulator->interrupt_pointer);
+    this->Write_Number(simulator->memory->count);
+    for (int page_index = 0; page_index < simulator->memory->page_count; page_index++) {
+      if (!simulator->memory->Is_Page_Clear(page_index)) {
+        int start = page_index * MEMORY_PAGE_SIZE;
+        int end = std::min(start + MEMORY_PAGE_SIZE, simulator->memory->count);
+        this->Write_Number(page_index + 1);
+        for (int address = start; address < end; address++) {
+          this->Write_Signed(simulator->memory->memory[address]);
+        }
+      }
+    }
+    this->Write_Number(0);
+    std::vector<unsigned char> checkpoint;
+    checkpoint.swap(this->data);
+    this->data.swap(events);
+    this->data.push_back('C');
+    this->Write_Number(simulator->instructions - this->last_instruction);
+    this->Write_Number(checkpoint.size());
+    this->data.insert(this->data.end(), checkpoint.begin(), checkpoint.end());
+    this->last_instruction = simulator->instructions;
+    this->next_checkpoint = simulator->instructions + this->interval;
+    this->Flush();
+  }
+
+  /**
+   * Writes out the recorded events.
+   */
+  void cTrace::Flush() {
+    if (this->data.size() > 0) {
+      this->file.write((char*)&this->data[0], this->data.size());
+      this->file.flush();
+      this->data.clear();
+    }
+  }
+
+  /**
+   * Replays the next event. Checkpoints are passed over.
+   * @param type The type of event the program is doing.
+   * @param instruction The instruction count.
+   * @return The value of the event.
+   * @throws An error if the next event in the trace is not this one.
+   */
+  int cTrace::Replay_Event(char type, long long instruction) {
+    int event_count = this->events.size();
+    while ((this->event_index < event_count) && (this->events[this->event_index].type == 'C')) {
+      this->event_index++;
+    }
+    if ((this->event_index == event_count) || (this->events[this->event_index].type != type) || (this->events[this->event_index].instruction != instruction)) {
+      throw cError("Replay left the trace at instruction " + std::to_string(instruction) + ".");
+    }
+    return this->events[this->event_index++].value;
+  }
+
+  /**
+   * Replays a key that was read.
+   * @param instruction The instruction count.
+   * @return The key code.
+   * @throws An error if the program did not read a key here in the trace.
+   */
+  int cTrace::Replay_Key(long long instruction) {
+    return this->Replay_Event('K', instruction);
+  }
+
+  /**
+   * Checks a timer against the trace.
+   * @param instruction The instruction count.
+   * @param delay The timer delay.
+   * @throws An error if the program did not start this timer here in the
+   * trace.
+   */
+  void cTrace::Replay_Timer(long long instruction, int delay) {
+    if (this->Replay_Event('T', instruction) != delay) {
+      throw cError("Replay started a different timer at instruction " + std::to_string(instruction) + ".");
+    }
+  }
+
+  /**
+   * Gets the instruction count at the end of the trace.
+   * @return The instruction count.
+   */
+  long long cTrace::Get_End() {
+    return (this->events.size() > 0) ? this->events.back().instruction : 0;
+  }
+
+  /**
+   * Determines if the recorded run ended with an error.
+   * @return True if the run failed, false otherwise.
+   */
+  bool cTrace::Has_Failed() {
+    return (this->events.size() > 0) && (this->events.back().type == 'E') && (this->events.back().value == 1);
+  }
+
+  /**
+   * Moves a simulator to any instruction in the trace. The closest checkpoint
+   * before the instruction is loaded and then the program is run forward.
+   * @param simulator The simulator.
+   * @param instruction The instruction count to stop at.
+   * @throws An error if the trace has no checkpoint before the instruction.
+   */
+  void cTrace::Seek(cSimulator* simulator, long long instruction) {
+    int checkpoint = -1;
+    int event_count = this->events.size();
+    for (int event_index = 0; event_index < event_count; event_index++) {
+      if ((this->events[event_index].type == 'C') && (this->events[event_index].instruction <= instruction)) {
+        checkpoint = event_index;
+      }
+    }
+    if (checkpoint == -1) {
+      throw cError("No checkpoint before instruction " + std::to_string(instruction) + ".");
+    }
+    // Load the checkpoint.
+    this->cursor = this->events[checkpoint].offset;
+    simulator->pc = this->Read_Signed();
+    simulator->sp = this->Read_Signed();
+    simulator->status = this->Read_Signed();
+    simulator->interrupt_pointer = this->Read_Signed();
+    int memory_size = this->Read_Number();
+    if (memory_size != simulator->memory->count) {
+      delete simulator->memory;
+      simulator->memory = new cMemory(memory_size);
+    }
+    else {
+      simulator->memory->Clear();
+    }
+    int page = this->Read_Number();
+    while (page != 0) {
+      int start = (page - 1) * MEMORY_PAGE_SIZE;
+      int end = std::min(start + MEMORY_PAGE_SIZE, memory_size);
+      for (int address = start; address < end; address++) {
+        simulator->memory->Write_Number(address, this->Read_Signed());
+      }
+      page = this->Read_Number();
+    }
+    simulator->instructions = this->events[checkpoint].instruction;
+    simulator->spinning = false;
+    simulator->spin_count = 0;
+    this->event_index = checkpoint + 1;
+    // Run up to the instruction.
+    while ((simulator->instructions < instruction) && (simulator->status == eSTATUS_RUNNING)) {
+      simulator->Step();
+      simulator->instructions++;
+    }
+  }
+
+  /**
+   * Writes a number in as few bytes as it needs. Each byte holds seven bits
+   * and the top bit says if more bytes follow.
+   * @param number The number to write.
+   */
+  void cTrace::Write_Number(unsigned long long number) {
+    while (number >= 0x80) {
+      this->data.push_back((unsigned char)(number | 0x80));
+      number >>= 7;
+    }
+    this->data.push_back((unsigned char)number);
+  }
+
+  /**
+   * Writes a signed number so that small negative numbers stay small.
+   * @param number The number to write.
+   */
+  void cTrace::Write_Signed(long long number) {
+    this->Write_Number(((unsigned long long)number << 1) ^ (unsigned long long)(number >> 63));
+  }
+
+  /**
+   * Reads a number written by Write_Number.
+   * @return The number.
+   * @throws An error if the trace is cut short.
+   */
+  unsigned long long cTrace::Read_Number() {
+    unsigned long long number = 0;
+    int shift = 0;
+    while (true) {
+      if (this->cursor >= this->data.size()) {
+        throw cError("Trace " + this->name + " is cut short.");
+      }
+      unsigned char byte = this->data[this->cursor++];
+      number |= (unsigned long long)(byte & 0x7F) << shift;
+      if (!(byte & 0x80)) {
+        break;
+      }
+      shift += 7;
+    }
+    return number;
+  }
+
+  /**
+   * Reads a number written by Write_Signed.
+   * @return The number.
+   * @throws An error if the trace is cut short.
+   */
+  long long cTrace::Read_Signed() {
+    unsigned long long number = this->Read_Number();
+    return (long long)(number >> 1) ^ -(long long)(number & 1);
+  }
+
+  // **************************************************************************
+  // Headless I/O Implementation
+  // **************************************************************************
+
+  /**
+   * Creates an I/O control that has no window or keyboard.
+   */
+  cHeadless_IO::cHeadless_IO() {
+    this->frames = 0;
+    this->reads = 0;
+    this->wake_time = std::chrono::steady_clock::now();
+  }
+
+  /**
+   * Reads a key. There is no keyboard so the program waits a bit before
+   * polling again.
+   * @return A signal with no key code.
+   */
+  sSignal cHeadless_IO::Read_Key() {
+    sSignal key;
+    key.code = 0;
+    this->reads++;
+    this->wake_time = std::chrono::steady_clock::now() + std::chrono::milliseconds(1);
+    return key;
+  }
+
+  /**
+   * Starts a timer. The program is blocked until the timer runs out.
+   * @param delay The delay in milliseconds.
+   */
+  void cHeadless_IO::Timeout(int delay) {
+    this->wake_time = std::chrono::steady_clock::now() + std::chrono::milliseconds(delay);
+  }
+
+  /**
+   * Sets the drawing color. Nothing is drawn.
+   * @param red The red component.
+   * @param green The green component.
+   * @param blue The blue component.
+   */
+  void cHeadless_IO::Color(int red, int green, int blue) {
+    // Nothing to draw to.
+  }
+
+  /**
+   * Outputs text. Nothing is drawn.
+   * @param text The text to output.
+   * @param x The x coordinate.
+   * @param y The y coordinate.
+   * @param red The red component.
+   * @param green The green component.
+   * @param blue The blue component.
+   */
+  void cHeadless_IO::Output_Text(std::string text, int x, int y, int red, int green, int blue) {
+    // Nothing to draw to.
+  }
+
+  /**
+   * Counts a screen refresh.
+   */
+  void cHeadless_IO::Refresh() {
+    this->frames++;
+  }
+
+  /**
+   * Determines if the program is waiting on input or a timer.
+   * @return True if the program is blocked, false otherwise.
+   */
+  bool cHeadless_IO::Is_Blocked() {
+    return (std::chrono::steady_clock::now() < this->wake_time);
+  }
+
+  // **************************************************************************
+  // Host Implementation
+  // **************************************************************************
+
+  /**
+   * Creates a host that runs many programs at once. There is one worker per
+   * core and each worker has its own queue of programs.
+   */
+  cHost::cHost() {
+    this->worker_count = std::thread::hardware_concurrency();
+    if (this->worker_count < 1) {
+      this->worker_count = 1;
+    }
+    this->queues = new std::deque<int>[this->worker_count];
+    this->locks = new std::mutex[this->worker_count];
+    this->remaining = 0;
+    this->idle = 0;
+  }
+
+  /**
+   * Frees the programs and the workers.
+   */
+  cHost::~cHost() {
+    int vm_count = this->simulators.Count();
+    for (int vm_index = 0; vm_index < vm_count; vm_index++) {
+      delete this->simulators[vm_index];
+      delete this->ios[vm_index];
+    }
+    delete[] this->queues;
+    delete[] this->locks;
+  }
+
+  /**
+   * Loads all of the programs named in a list. Each program gets its own
+   * memory and I/O.
+   * @param list The name of the list file with one program per line.
+   * @throws An error if the list or a program could not be loaded.
+   */
+  void cHost::Load_Programs(std::string list) {
+    cFile list_file(list + ".txt");
+    list_file.Read();
+    while (list_file.Has_More_Lines()) {
+      std::string name = list_file.Get_Line();
+      if (name.length() > 0) {
+        cHeadless_IO* io = new cHeadless_IO();
+        cSimulator* simulator = new cSimulator(io, "Config");
+        this->ios.Push(io);
+        this->simulators.Push(simulator);
+        this->names.Push(name);
+        this->errors.Push("");
+        simulator->Load_Program(name);
+      }
+    }
+  }
+
+  /**
+   * Runs all of the programs until they halt, fail, or spin forever.
+   */
+  void cHost::Run() {
+    int vm_count = this->simulators.Count();
+    // Deal out the programs to the workers.
+    for (int vm_index = 0; vm_index < vm_count; vm_index++) {
+      this->queues[vm_index % this->worker_count].push_back(vm_index);
+    }
+    this->remaining = vm_count;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    cArray<std::thread*> workers;
+    for (int worker_index = 0; worker_index < this->worker_count; worker_index++) {
+      workers.Push(new std::thread(&cHost::Work, this, worker_index));
+    }
+    for (int worker_index = 0; worker_index < this->worker_count; worker_index++) {
+      workers[worker_index]->join();
+      delete workers[worker_index];
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    this->Report(elapsed.count());
+  }
+
+  /**
+   * Runs programs in slices until there is nothing left to run. Programs
+   * that block on input or a timer are parked off the queues until they
+   * wake, and a worker with nothing to run sleeps until there is.
+   * @param worker The worker number.
+   */
+  void cHost::Work(int worker) {
+    while (this->remaining > 0) {
+      int vm = 0;
+      if (this->Take_Work(worker, vm)) {
+        cSimulator* simulator = this->simulators[vm];
+        try {
+          simulator->Run_Slice(HOST_SLICE);
+        }
+        catch (cError error) {
+          this->errors[vm] = error.message;
+          simulator->status = eSTATUS_ERROR;
+        }
+        if ((simulator->status != eSTATUS_RUNNING) || simulator->spinning) {
+          this->Finish(); // Nothing will wake a spinning program here.
+        }
+        else if (this->ios[vm]->Is_Blocked()) {
+          this->Park(vm);
+        }
+        else {
+          this->Give_Work(worker, vm);
+        }
+        std::lock_guard<std::mutex> lock(this->park_lock);
+        this->Unpark(worker);
+      }
+      else {
+        this->Wait_For_Work(worker);
+      }
+    }
+  }
+
+  /**
+   * Takes a program to run. Programs come from the front of the worker's own
+   * queue or are stolen from the back of another worker's queue.
+   * @param worker The worker number.
+   * @param vm The program number is written here.
+   * @return True if a program was found, false otherwise.
+   */
+  bool cHost::Take_Work(int worker, int& vm) {
+    for (int offset = 0; offset < this->worker_count; offset++) {
+      int victim = (worker + offset) % this->worker_count;
+      std::lock_guard<std::mutex> lock(this->locks[victim]);
+      std::deque<int>& queue = this->queues[victim];
+      if (!queue.empty()) {
+        if (victim == worker) {
+          vm = queue.front();
+          queue.pop_front();
+        }
+        else {
+          vm = queue.back();
+          queue.pop_back();
+        }
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /**
+   * Puts a program back on the worker's queue and wakes an idle worker to
+   * steal it.
+   * @param worker The worker number.
+   * @param vm The program number.
+   */
+  void cHost::Give_Work(int worker, int vm) {
+    {
+      std::lock_guard<std::mutex> lock(this->locks[worker]);
+      this->queues[worker].push_back(vm);
+    }
+    if (this->idle > 0) {
+      std::lock_guard<std::mutex> lock(this->park_lock);
+      this->wake.notify_one();
+    }
+  }
+
+  /**
+   * Determines if any worker has a program waiting to run.
+   * @return True if there is work, false otherwise.
+   */
+  bool cHost::Has_Work() {
+    for (int worker_index = 0; worker_index < this->worker_count; worker_index++) {
+      std::lock_guard<std::mutex> lock(this->locks[worker_index]);
+      if (!this->queues[worker_index].empty()) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /**
+   * Parks a program that is blocked on input or a timer until its wake time.
+   * Idle workers are woken so they can sleep until the new earliest wake.
+   * @param vm The program number.
+   */
+  void cHost::Park(int vm) {
+    std::lock_guard<std::mutex> lock(this->park_lock);
+    this->parked.insert(std::make_pair(this->ios[vm]->wake_time, vm));
+    this->wake.notify_all();
+  }
+
+  /**
+   * Moves parked programs whose wake time has passed onto the worker's queue.
+   * The park lock must be held.
+   * @param worker The worker number.
+   * @return The number of programs that woke.
+   */
+  int cHost::Unpark(int worker) {
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    int woken = 0;
+    while (!this->parked.empty() && (this->parked.begin()->first <= now)) {
+      std::lock_guard<std::mutex> queue_lock(this->locks[worker]);
+      this->queues[worker].push_back(this->parked.begin()->second);
+      this->parked.erase(this->parked.begin());
+      woken++;
+    }
+    if ((woken > 0) && (this->idle > 0)) {
+      this->wake.notify_all(); // Let the idle workers steal some.
+    }
+    return woken;
+  }
+
+  /**
+   * Sleeps until a parked program wakes, another worker queues a program,
+   * or everything is done. Programs that have woken are moved onto this
+   * worker's queue.
+   * @param worker The worker number.
+   */
+  void cHost::Wait_For_Work(int worker) {
+    std::unique_lock<std::mutex> lock(this->park_lock);
+    this->idle++;
+    while (this->remaining > 0) {
+      if ((this->Unpark(worker) > 0) || this->Has_Work()) {
+        break;
+      }
+      if (this->parked.empty()) {
+        this->wake.wait(lock);
+      }
+      else {
+        this->wake.wait_until(lock, this->parked.begin()->first);
+      }
+    }
+    this->idle--;
+  }
+
+  /**
+   * Counts a program as done. The last one wakes all of the idle workers so
+   * they can exit.
+   */
+  void cHost::Finish() {
+    if (--this->remaining == 0) {
+      std::lock_guard<std::mutex> lock(this->park_lock);
+      this->wake.notify_all();
+    }
+  }
+
+  /**
+   * Reports instruction counts for each program and overall throughput.
+   * @param seconds The time it took to run all programs.
+   */
+  void cHost::Report(double seconds) {
+    long long total = 0;
+    int vm_count = this->simulators.Count();
+    for (int vm_index = 0; vm_index < vm_count; vm_index++) {
+      cSimulator* simulator = this->simulators[vm_index];
+      std::string state = "halted";
+      if (simulator->status == eSTATUS_ERROR) {
+        state = "error: " + this->errors[vm_index];
+      }
+      else if (simulator->spinning) {
+        state = "spinning";
+      }
+      std::cout << this->names[vm_index] << ": " << simulator->instructions << " instructions, " << state << std::endl;
+      total += simulator->instructions;
+    }
+    std::cout << "Ran " << vm_count << " programs on " << this->worker_count << " workers." << std::endl;
+    std::cout << "Executed " << total << " instructions in " << seconds << " seconds";
+    if (seconds > 0) {
+      std::cout << " (" << (long long)(total / seconds) << " per second)";
+    }
+    std::cout << "." << std::endl;
+  }
+
+  // **************************************************************************
+  // Server Implementation
+  //
+  // The server listens on a local socket and keeps simulators warm between
+  // requests. Each request is one line and each answer ends with a line that
+  // starts with ok or error.
+  //
+  //   compile <program>
+  //   run <program> [instructions]
+  //   stop
+  // **************************************************************************
+
+  /**
+   * Creates a server on a local socket.
+   * @param name The name of the socket. The socket file is <name>.sock.
+   * @throws An error if the socket could not be opened.
+   */
+  cServer::cServer(std::string name) {
+    this->path = name + ".sock";
+    this->stopping = false;
+    cServer::Start_Sockets();
+    std::remove(this->path.c_str()); // Left over from a server that died.
+    this->listener = cServer::Open_Socket(this->path, true);
+  }
+
+  /**
+   * Closes the socket and frees the simulators.
+   */
+  cServer::~cServer() {
+    close_socket(this->listener);
+    std::remove(this->path.c_str());
+    int simulator_count = this->simulators.Count();
+    for (int simulator_index = 0; simulator_index < simulator_count; simulator_index++) {
+      delete this->simulators[simulator_index];
+      delete this->ios[simulator_index];
+    }
+  }
+
+  /**
+   * Accepts clients until a stop request comes in. Each client is served on
+   * its own thread. Every client is hung up on and its thread joined before
+   * this returns so no thread can use the server after it is freed.
+   */
+  void cServer::Run() {
+    std::cout << "Serving on " << this->path << "." << std::endl;
+    while (!this->stopping) {
+      tSocket client = accept(this->listener, NULL, NULL);
+      this->Reap_Clients();
+      if (client == INVALID_SOCKET) {
+        continue;
+      }
+      if (this->stopping) {
+        close_socket(client); // Came in after the stop.
+        break;
+      }
+      std::lock_guard<std::mutex> lock(this->client_lock);
+      this->clients[client] = new std::thread(&cServer::Serve_Client, this, client);
+    }
+    {
+      // Wake up clients waiting on a request. A client in the middle of a
+      // request finishes it first.
+      std::lock_guard<std::mutex> lock(this->client_lock);
+      for (std::map<tSocket, std::thread*>::iterator client = this->clients.begin(); client != this->clients.end(); client++) {
+        shutdown(client->first, SHUTDOWN_BOTH);
+      }
+    }
+    // Each client puts itself on the finished list when it is done.
+    while (true) {
+      this->Reap_Clients();
+      {
+        std::lock_guard<std::mutex> lock(this->client_lock);
+        if (this->clients.size() == 0) {
+          break;
+        }
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+  }
+
+  /**
+   * Joins the threads of clients that hung up and closes their sockets. A
+   * socket stays open until it is reaped so its number is not reused while
+   * it is still in the client list.
+   */
+  void cServer::Reap_Clients() {
+    std::lock_guard<std::mutex> lock(this->client_lock);
+    while (this->finished.Count() > 0) {
+      tSocket client = this->finished.Pop();
+      this->clients[client]->join();
+      delete this->clients[client];
+      this->clients.erase(client);
+      close_socket(client);
+    }
+  }
+
+  /**
+   * Answers requests from a client until it hangs up.
+   * @param client The client socket.
+   */
+  void cServer::Serve_Client(tSocket client) {
+    std::string request;
+    while (cServer::Read_Line(client, request)) {
+      if (request == "stop") {
+        this->stopping = true;
+        cServer::Send_Text(client, "ok stopping\n");
+        // Wake up the accept call.
+        tSocket wake = cServer::Open_Socket(this->path, false);
+        if (wake != INVALID_SOCKET) {
+          close_socket(wake);
+        }
+        break;
+      }
+      cServer::Send_Text(client, this->Handle_Request(request));
+    }
+    std::lock_guard<std::mutex> lock(this->client_lock);
+    this->finished.Push(client); // Closed by the accepting thread.
+  }
+
+  /**
+   * Handles a request on a warm simulator.
+   * @param request The request line.
+   * @return The answer to send back.
+   */
+  std::string cServer::Handle_Request(std::string request) {
+    cArray<std::string> words = Parse_Sausage_Text(request, " ");
+    if (words.Count() == 0) {
+      return "error Empty request.\n";
+    }
+    cSimulator* simulator = this->Take_Simulator();
+    std::string answer = "";
+    try {
+      simulator->Reset();
+      if ((words[0] == "compile") && (words.Count() == 2)) {
+        cAssembler assembler(simulator);
+        assembler.Load_Source(words[1]);
+        assembler.Compile_Source(words[1]);
+        answer = "ok " + Number_To_Text(assembler.line_count) + " lines\n";
+      }
+      else if ((words[0] == "run") && ((words.Count() == 2) || (words.Count() == 3))) {
+        long long limit = (words.Count() == 3) ? Text_To_Number(words[2]) : SERVER_RUN_LIMIT;
+        cHeadless_IO* io = (cHeadless_IO*)simulator->io;
+        simulator->Load_Program(words[1]);
+        while ((simulator->status == eSTATUS_RUNNING) && !simulator->spinning && (simulator->instructions < limit)) {
+          int budget = (int)std::min((long long)HOST_SLICE, limit - simulator->instructions);
+          int reads = io->reads;
+          simulator->Run_Slice(budget);
+          if (simulator->yielding && (io->reads > reads)) {
+            break; // Waiting on input that will never come.
+          }
+        }
+        // The limit fits in a number so the count does too.
+        answer = simulator->Get_Screen_Text();
+        answer += "ok " + Number_To_Text((int)simulator->instructions) + " instructions\n";
+      }
+      else {
+        answer = "error Invalid request " + request + ".\n";
+      }
+    }
+    catch (cASM_Error asm_error) {
+      answer = "error " + asm_error.token.source + " line " + Number_To_Text(asm_error.token.line_no) + ": " + asm_error.message + "\n";
+    }
+    catch (cError error) {
+      answer = "error " + error.message + "\n";
+    }
+    this->Give_Simulator(simulator);
+    return answer;
+  }
+
+  /**
+   * Takes a warm simulator or makes a new one if they are all busy.
+   * @return The simulator.
+   */
+  cSimulator* cServer::Take_Simulator() {
+    std::lock_guard<std::mutex> lock(this->pool_lock);
+    if (this->pool.Count() > 0) {
+      return this->pool.Pop();
+    }
+    cHeadless_IO* io = new cHeadless_IO();
+    cSimulator* simulator = new cSimulator(io, "Config");
+    this->ios.Push(io);
+    this->simulators.Push(simulator);
+    return simulator;
+  }
+
+  /**
+   * Puts a simulator back so the next request can use it.
+   * @param simulator The simulator.
+   */
+  void cServer::Give_Simulator(cSimulator* simulator) {
+    std::lock_guard<std::mutex> lock(this->pool_lock);
+    this->pool.Push(simulator);
+  }
+
+  /**
+   * Starts up sockets. Only Windows needs this.
+   * @throws An error if sockets could not be started.
+   */
+  void cServer::Start_Sockets() {
+#ifdef _WIN32
+    WSADATA data;
+    if (WSAStartup(MAKEWORD(2, 2), &data) != 0) {
+      throw cError("Could not start sockets.");
+    }
+#endif
+  }
+
+  /**
+   * Opens a local socket.
+   * @param path The path of the socket file.
+   * @param listen True to listen for clients, false to connect to a server.
+   * @return The socket.
+   * @throws An error if a listening socket could not be opened.
+   */
+  tSocket cServer::Open_Socket(std::string path, bool listen) {
+    tSocket local = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (local == INVALID_SOCKET) {
+      throw cError("Could not create socket.");
+    }
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+    if (listen) {
+      if ((bind(local, (sockaddr*)&address, sizeof(address)) != 0) || (::listen(local, SOMAXCONN) != 0)) {
+        close_socket(local);
+        throw cError("Could not listen on " + path + ".");
+      }
+    }
+    else if (connect(local, (sockaddr*)&address, sizeof(address)) != 0) {
+      close_socket(local);
+      return INVALID_SOCKET;
+    }
+    return local;
+  }
+
+  /**
+   * Reads a line from a socket one byte at a time so nothing past the line
+   * is taken.
+   * @param client The socket.
+   * @param line The line without the line break is put here.
+   * @return True if a line was read, false if the socket was closed.
+   */
+  bool cServer::Read_Line(tSocket client, std::string& line) {
+    line = "";
+    char letter = 0;
+    while (recv(client, &letter, 1, 0) == 1) {
+      if (letter == '\n') {
+        return true;
+      }
+      if (letter != '\r') {
+        line += letter;
+      }
+    }
+    return (line.length() > 0);
+  }
+
+  /**
+   * Sends text over a socket.
+   * @param client The socket.
+   * @param text The text to send.
+   */
+  void cServer::Send_Text(tSocket client, std::string text) {
+    size_t sent = 0;
+    while (sent < text.length()) {
+      int count = send(client, text.c_str() + sent, text.length() - sent, 0);
+      if (count <= 0) {
+        break; // The client hung up.
+      }
+      sent += count;
+    }
+  }
+
+  /**
+   * Sends a request to a server and prints the answer.
+   * @param name The name of the server socket.
+   * @param request The request line.
+   * @throws An error if the server could not be reached.
+   */
+  void cServer::Send_Request(std::string name, std::string request) {
+    cServer::Start_Sockets();
+    tSocket server = cServer::Open_Socket(name + ".sock", false);
+    if (server == INVALID_SOCKET) {
+      throw cError("Could not reach server " + name + ".");
+    }
+    cServer::Send_Text(server, request + "\n");
+    std::string line;
+    while (cServer::Read_Line(server, line)) {
+      std::cout << line << std::endl;
+      if ((line.substr(0, 2) == "ok") || (line.substr(0, 5) == "error")) {
+        break;
+      }
+    }
+    close_socket(server);
+  }
+
+  // **************************************************************************
+  // Debugger Implementation
+  //
+  // Breakpoints patch a trap instruction over the code and keep the real
+  // word on the side. Watchpoints arm the write trap of their page. Nothing
+  // is checked per instruction so a program runs at full speed between hits.
+  //
+  //   break | delete <location>       Sets or removes a breakpoint.
+  //   watch | unwatch <location>      Sets or removes a watchpoint.
+  //   step [count]                    Runs a number of instructions.
+  //   continue [instructions]         Runs until a hit or the limit.
+  //   regs                            Shows the registers.
+  //   mem <location> [count]          Shows memory.
+  //   where                           Shows the current instruction.
+  //   quit                            Leaves the debugger.
+  //
+  // A location is an address, a label, or a label plus an offset.
+  // **************************************************************************
+
+  /**
+   * Creates a debugger and loads the program to debug.
+   * @param simulator The simulator to debug on.
+   * @param program The name of the program.
+   * @throws An error if the program could not be loaded.
+   */
+  cDebugger::cDebugger(cSimulator* simulator, std::string program) {
+    this->simulator = simulator;
+    this->quitting = false;
+    this->simulator->Load_Program(program);
+    this->simulator->debugging = true;
+    this->simulator->memory->watch_flag = &this->simulator->yielding;
+    try {
+      this->symbols.Load(program);
+    }
+    catch (cError error) {
+      std::cout << "No symbols, using addresses." << std::endl;
+    }
+  }
+
+  /**
+   * Takes out the breakpoints and watchpoints so the simulator is left clean.
+   */
+  cDebugger::~cDebugger() {
+    while (!this->breakpoints.empty()) {
+      this->Remove_Breakpoint(this->breakpoints.begin()->first);
+    }
+    for (std::map<int, int>::iterator watch = this->watches.begin(); watch != this->watches.end(); ++watch) {
+      this->simulator->memory->Unwatch(watch->first);
+    }
+    this->simulator->memory->watch_flag = NULL;
+    this->simulator->debugging = false;
+  }
+
+  /**
+   * Runs debugger commands until quit or the end of the script.
+   * @param script The script file to read commands from or blank to read
+   * them from the console.
+   * @throws An error if the script could not be read.
+   */
+  void cDebugger::Run(std::string script) {
+    this->Print_Where();
+    if (script.length() > 0) {
+      cFile script_file(script);
+      script_file.Read();
+      while (script_file.Has_More_Lines() && !this->quitting) {
+        std::string command = script_file.Get_Line();
+        std::cout << "> " << command << std::endl;
+        this->Do_Command(command);
+      }
+    }
+    else {
+      std::string command;
+      while (!this->quitting && std::getline(std::cin, command)) {
+        this->Do_Command(command);
+      }
+    }
+  }
+
+  /**
+   * Does one debugger command. Errors are printed so a script keeps going.
+   * @param command The command line.
+   */
+  void cDebugger::Do_Command(std::string command) {
+    cArray<std::string> words = Parse_Sausage_Text(command, " ");
+    if (words.Count() == 0) {
+      return;
+    }
+    try {
+      int word_count = words.Count();
+      if ((words[0] == "break") && (word_count == 2)) {
+        this->Add_Breakpoint(this->Get_Address(words[1]));
+      }
+      else if ((words[0] == "delete") && (word_count == 2)) {
+        this->Remove_Breakpoint(this->Get_Address(words[1]));
+      }
+      else if ((words[0] == "watch") && (word_count == 2)) {
+        int address = this->Get_Address(words[1]);
+        if (this->watches.find(address) == this->watches.end()) {
+          this->simulator->memory->Watch(address);
+          this->watches[address] = this->simulator->memory->Read_Number(address);
+        }
+        std::cout << "Watching " << this->symbols.Find_Name(address) << "." << std::endl;
+      }
+      else if ((words[0] == "unwatch") && (word_count == 2)) {
+        int address = this->Get_Address(words[1]);
+        if (this->watches.erase(address) > 0) {
+          this->simulator->memory->Unwatch(address);
+        }
+      }
+      else if ((words[0] == "step") && (word_count <= 2)) {
+        this->Step((word_count == 2) ? Text_To_Number(words[1]) : 1);
+      }
+      else if (((words[0] == "continue") || (words[0] == "c")) && (word_count <= 2)) {
+        this->Continue((word_count == 2) ? Text_To_Number(words[1]) : DEBUG_RUN_LIMIT);
+      }
+      else if (words[0] == "regs") {
+        this->Print_Registers();
+      }
+      else if ((words[0] == "mem") && ((word_count == 2) || (word_count == 3))) {
+        this->Print_Memory(this->Get_Address(words[1]), (word_count == 3) ? Text_To_Number(words[2]) : 1);
+      }
+      else if (words[0] == "where") {
+        this->Print_Where();
+      }
+      else if (words[0] == "quit") {
+        this->quitting = true;
+      }
+      else {
+        throw cError("Invalid command " + command + ".");
+      }
+    }
+    catch (cError error) {
+      error.Print();
+    }
+  }
+
+  /**
+   * Gets an address from a location like 120, Loop, or Loop+3.
+   * @param text The location.
+   * @return The address.
+   * @throws An error if the label does not exist.
+   */
+  int cDebugger::Get_Address(std::string text) {
+    if ((text[0] >= '0') && (text[0] <= '9')) {
+      return Text_To_Number(text);
+    }
+    cArray<std::string> parts = Parse_Sausage_Text(text, "+");
+    int address = this->symbols.Find_Address(parts[0]);
+    if (parts.Count() == 2) {
+      address += Text_To_Number(parts[1]);
+    }
+    return address;
+  }
+
+  /**
+   * Patches a trap over an instruction.
+   * @param address The address of the instruction.
+   * @throws An error if the address is invalid.
+   */
+  void cDebugger::Add_Breakpoint(int address) {
+    if (this->breakpoints.find(address) == this->breakpoints.end()) {
+      int original = this->simulator->memory->Read_Number(address);
+      this->simulator->memory->Write_Number(address, eINST_TRAP);
+      this->breakpoints[address] = original;
+    }
+    std::cout << "Breakpoint at " << this->symbols.Find_Name(address) << "." << std::endl;
+  }
+
+  /**
+   * Puts back the instruction under a breakpoint.
+   * @param address The address of the breakpoint.
+   */
+  void cDebugger::Remove_Breakpoint(int address) {
+    std::map<int, int>::iterator breakpoint = this->breakpoints.find(address);
+    if (breakpoint != this->breakpoints.end()) {
+      this->simulator->memory->Write_Number(address, breakpoint->second);
+      this->breakpoints.erase(breakpoint);
+    }
+  }
+
+  /**
+   * Reads memory as the program sees it, looking under breakpoints.
+   * @param address The address to read.
+   * @return The number at the address.
+   * @throws An error if the address is invalid.
+   */
+  int cDebugger::Read_Original(int address) {
+    std::map<int, int>::iterator breakpoint = this->breakpoints.find(address);
+    if (breakpoint != this->breakpoints.end()) {
+      return breakpoint->second;
+    }
+    return this->simulator->memory->Read_Number(address);
+  }
+
+  /**
+   * Runs instructions one at a time. A breakpoint under the program counter
+   * is lifted for the step and put back after.
+   * @param count The number of instructions to run.
+   * @throws An error if an instruction fails.
+   */
+  void cDebugger::Step(int count) {
+    for (int step_index = 0; step_index < count; step_index++) {
+      if (this->simulator->status != eSTATUS_RUNNING) {
+        break;
+      }
+      int pc = this->simulator->pc;
+      std::map<int, int>::iterator breakpoint = this->breakpoints.find(pc);
+      if (breakpoint != this->breakpoints.end()) {
+        this->simulator->memory->Write_Number(pc, breakpoint->second);
+        this->simulator->Run_Slice(1);
+        this->simulator->memory->Write_Number(pc, eINST_TRAP);
+      }
+      else {
+        this->simulator->Run_Slice(1);
+      }
+      if (this->Check_Watches()) {
+        break;
+      }
+    }
+    this->Print_Where();
+  }
+
+  /**
+   * Runs the program until it hits a breakpoint or watchpoint, stops, or
+   * runs out of instructions.
+   * @param limit The most instructions to run.
+   * @throws An error if an instruction fails.
+   */
+  void cDebugger::Continue(long long limit) {
+    long long end = this->simulator->instructions + limit;
+    if (this->breakpoints.find(this->simulator->pc) != this->breakpoints.end()) {
+      this->Step(1); // Get off the breakpoint first.
+    }
+    cHeadless_IO* io = (cHeadless_IO*)this->simulator->io;
+    bool waiting = false;
+    while ((this->simulator->status == eSTATUS_RUNNING) && !this->simulator->spinning && (this->simulator->instructions < end)) {
+      int budget = (int)std::min((long long)HOST_SLICE, end - this->simulator->instructions);
+      int reads = io->reads;
+      this->simulator->Run_Slice(budget);
+      if (this->simulator->breaking) {
+        this->simulator->breaking = false;
+        this->simulator->instructions--; // The trap was not a real instruction.
+        std::cout << "Hit breakpoint at " << this->symbols.Find_Name(this->simulator->pc) << "." << std::endl;
+        break;
+      }
+      if (this->Check_Watches()) {
+        break;
+      }
+      if (this->simulator->yielding && (io->reads > reads)) {
+        waiting = true; // Waiting on input that will never come.
+        break;
+      }
+    }
+    if (waiting) {
+      std::cout << "Program is waiting on input." << std::endl;
+    }
+    else if (this->simulator->spinning) {
+      std::cout << "Program is waiting in a loop." << std::endl;
+    }
+    this->Print_Where();
+  }
+
+  /**
+   * Looks for watched addresses that changed. A write to a watched page
+   * only stops the run, so the values tell which watch was hit.
+   * @return True if a watched value changed, false otherwise.
+   */
+  bool cDebugger::Check_Watches() {
+    bool changed = false;
+    for (std::map<int, int>::iterator watch = this->watches.begin(); watch != this->watches.end(); ++watch) {
+      int value = this->simulator->memory->Read_Number(watch->first);
+      if (value != watch->second) {
+        std::cout << "Watch " << this->symbols.Find_Name(watch->first) << ": " << watch->second << " -> " << value << std::endl;
+        watch->second = value;
+        changed = true;
+      }
+    }
+    return changed;
+  }
+
+  /**
+   * Prints the current instruction.
+   */
+  void cDebugger::Print_Where() {
+    int pc = this->simulator->pc;
+    std::string name = "?";
+    if ((pc >= 0) && (pc < this->simulator->memory->count)) {
+      name = Get_Instruction_Name(this->Read_Original(pc));
+    }
+    std::cout << "At " << this->symbols.Find_Name(pc) << " (" << pc << "): " << name << ", instruction " << this->simulator->instructions << "." << std::endl;
+  }
+
+  /**
+   * Prints the registers.
+   */
+  void cDebugger::Print_Registers() {
+    std::cout << "pc=" << this->simulator->pc << " (" << this->symbols.Find_Name(this->simulator->pc) << ")";
+    std::cout << ", sp=" << this->simulator->sp;
+    std::cout << ", status=" << this->simulator->status;
+    std::cout << ", interrupt=" << this->simulator->interrupt_pointer;
+    std::cout << ", instructions=" << this->simulator->instructions << std::endl;
+  }
+
+  /**
+   * Prints a run of memory with one address per line.
+   * @param address The first address.
+   * @param count The number of addresses to print.
+   * @throws An error if an address is invalid.
+   */
+  void cDebugger::Print_Memory(int address, int count) {
+    for (int index = 0; index < count; index++) {
+      std::cout << this->symbols.Find_Name(address + index) << " (" << (address + index) << "): " << this->Read_Original(address + index) << std::endl;
+    }
+  }
+
+  // **************************************************************************
+  // Conformance Implementation
+  //
+  // Random programs are run on a plain model of the machine and on every
+  // engine the simulator has: Step on its own and Run_Slice at each vector
+  // level the CPU supports. Memory and registers are compared after every
+  // batch. A program that shows a difference is shrunk one instruction at a
+  // time while the difference stays. The engines all run the same Step
+  // switch, so the scalar instructions are only checked against the model
+  // and comparing engines with each other only covers the vector kernels.
+  // Run, with its checkpoints, traces and spin parking, is not checked.
+  //
+  // Programs only jump forward so they always end. The main routine can call
+  // short subroutines and start short threads that it joins right away, so
+  // every run is the same no matter how threads are scheduled. Writes only go
+  // to the data area and the stack. The pointer table always points into the
+  // data area so pointer reads and writes stay in memory.
+  // **************************************************************************
+
+  /**
+   * Determines if a simulator has a thread that was not joined yet.
+   * @param simulator The simulator.
+   * @return True if a thread is running, false otherwise.
+   */
+  static bool Has_Running_Thread(cSimulator* simulator) {
+    int thread_count = simulator->runners.Count();
+    for (int thread_index = 0; thread_index < thread_count; thread_index++) {
+      if (simulator->runners[thread_index]) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /**
+   * Creates a conformance harness.
+   * @param seed The seed for the random programs.
+   * @throws An error if the config could not be read.
+   */
+  cConformance::cConformance(int seed) {
+    this->random.seed(seed);
+    cHeadless_IO headless;
+    cSimulator simulator(&headless, "Config");
+    this->grid_size = (simulator.width / simulator.letter_w) * (simulator.height / simulator.letter_h);
+    this->screen = CONFORM_MEMORY;
+    this->memory_size = CONFORM_MEMORY + this->grid_size;
+    this->instruction_hits.assign(eINST_TRAP + 1, 0);
+    this->mode_hits.assign(eADDRESS_POINTER + 1, 0);
+    this->test_hits.assign(eTEST_LESS_OR_EQUAL + 1, 0);
+    this->no_jumps = 0;
+    this->pointer_writes = 0;
+    this->zero_divides = 0;
+    int best = Find_Vector_Level();
+    for (int level = eVECTOR_SCALAR; level <= best; level++) {
+      this->levels.push_back(level);
+    }
+  }
+
+  /**
+   * Checks a number of random programs or as many as fit in the time budget.
+   * @param iterations The number of programs.
+   * @param budget The most time to spend in seconds.
+   * @throws An error if the engines disagree on a program.
+   */
+  void cConformance::Run(int iterations, int budget) {
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now() + std::chrono::seconds(budget);
+    int checked = 0;
+    while ((checked < iterations) && (std::chrono::steady_clock::now() < end)) {
+      sConform_Program program = this->Generate();
+      std::string message = this->Check(program);
+      checked++;
+      if (message.length() > 0) {
+        std::cout << "Program " << checked << ": " << message << " Shrinking..." << std::endl;
+        sConform_Program original = program;
+        this->Shrink(program);
+        std::string shrunk_message = this->Check(program);
+        if (shrunk_message.length() > 0) {
+          message = shrunk_message;
+        }
+        else {
+          program = original; // Keep what failed the first time.
+          message += " The failure did not reproduce after shrinking.";
+        }
+        this->Save_Failure(program, message);
+        Set_Vector_Level(this->levels.back());
+        throw cError("Engines disagree: " + message + " See Conform.fail.txt.");
+      }
+    }
+    Set_Vector_Level(this->levels.back());
+    if (checked < iterations) {
+      std::cout << "Time budget of " << budget << " seconds ran out." << std::endl;
+    }
+    std::cout << "Checked " << checked << " programs on " << (this->levels.size() + 1) << " engines." << std::endl;
+    std::cout << "Instructions are checked against the model. The engines share Step so they only differ in the vector kernels." << std::endl;
+    std::string missing = "";
+    for (int instruction = 0; instruction <= eINST_TRAP; instruction++) {
+      if (this->instruction_hits[instruction] == 0) {
+        missing += " " + Get_Instruction_Name(instruction);
+      }
+    }
+    std::cout << "Instructions missed:" << ((missing.length() > 0) ? missing : " none") << std::endl;
+    std::cout << "Address modes: value " << this->mode_hits[eADDRESS_VALUE] << ", immediate " << this->mode_hits[eADDRESS_IMMEDIATE] << ", pointer " << this->mode_hits[eADDRESS_POINTER] << " (" << this->pointer_writes << " writes)" << std::endl;
+    std::cout << "Tests:";
+    for (int test = 0; test <= eTEST_LESS_OR_EQUAL; test++) {
+      std::cout << " " << this->test_hits[test];
+    }
+    std::cout << " (" << this->no_jumps << " take no jump)" << std::endl;
+    std::cout << "Divides by zero: " << this->zero_divides << std::endl;
+  }
+
+  /**
+   * Generates a random program.
+   * @return The program.
+   */
+  sConform_Program cConformance::Generate() {
+    sConform_Program program;
+    for (int data_index = 0; data_index < CONFORM_DATA_SIZE; data_index++) {
+      program.data.push_back(this->Random_Value());
+    }
+    for (int pointer_index = 0; pointer_index < CONFORM_POINTER_COUNT; pointer_index++) {
+      program.pointers.push_back(CONFORM_DATA + this->Random(CONFORM_DATA_SIZE));
+    }
+    program.routines.resize(1 + (CONFORM_ROUTINES * 2));
+    int routine_count = (int)program.routines.size();
+    for (int routine = 0; routine < routine_count; routine++) {
+      int slot_count = (routine == 0) ? CONFORM_LENGTH : CONFORM_ROUTINE_LENGTH;
+      int depth = 0;
+      for (int slot = 0; slot < slot_count; slot++) {
+        program.routines[routine].push_back(this->Generate_Instruction(routine, slot, slot_count, depth));
+      }
+    }
+    return program;
+  }
+
+  /**
+   * Generates a random instruction. Subroutines and threads only get
+   * instructions that do not change the flow of the program.
+   * @param routine The routine number. The main routine is zero.
+   * @param slot The position of the instruction in the routine.
+   * @param slot_count The number of instructions in the routine.
+   * @param depth The number of values pushed so far.
+   * @return The instruction.
+   */
+  sGenerated cConformance::Generate_Instruction(int routine, int slot, int slot_count, int& depth) {
+    sGenerated generated;
+    generated.target = -1;
+    generated.other = -1;
+    int instruction = 0;
+    while (true) {
+      instruction = this->Random(eINST_TRAP + 1);
+      bool flow = (instruction == eINST_TEST) || (instruction == eINST_JUMP) || (instruction == eINST_JSUB) || (instruction == eINST_PUSH) ||
+        (instruction == eINST_POP) || (instruction == eINST_RETURN) || (instruction == eINST_HALT) || (instruction == eINST_INTERRUPT) ||
+        (instruction == eINST_SPAWN) || (instruction == eINST_JOIN) || (instruction == eINST_TRAP);
+      if ((routine > 0) && flow) {
+        continue;
+      }
+      if ((instruction == eINST_RETURN) || ((instruction == eINST_PUSH) && (depth >= 32)) || ((instruction == eINST_POP) && (depth == 0))) {
+        continue;
+      }
+      if (((instruction == eINST_HALT) || (instruction == eINST_TRAP)) && (this->Random(16) > 0)) {
+        continue; // These end the program so keep them rare.
+      }
+      break;
+    }
+    if (instruction == eINST_JOIN) {
+      instruction = eINST_SPAWN; // Threads are always joined right after they start.
+    }
+    generated.instruction = instruction;
+    this->instruction_hits[instruction]++;
+    std::vector<int>& words = generated.words;
+    switch (instruction) {
+      case eINST_COPY:
+      case eINST_NOT: {
+        this->Add_Read(words);
+        this->Add_Write(words);
+        break;
+      }
+      case eINST_DIV:
+      case eINST_MOD: {
+        this->Add_Read(words);
+        if (this->Random(3) == 0) {
+          words.push_back(eADDRESS_VALUE);
+          words.push_back(0);
+          this->zero_divides++;
+        }
+        else {
+          this->Add_Read(words);
+        }
+        this->Add_Write(words);
+        break;
+      }
+      case eINST_TEST: {
+        this->Add_Read(words);
+        int test = this->Random(eTEST_LESS_OR_EQUAL + 1);
+        this->test_hits[test]++;
+        words.push_back(test);
+        this->Add_Read(words);
+        generated.target = (this->Random(2) == 0) ? -1 : slot + 1 + this->Random(slot_count - slot);
+        generated.other = (this->Random(2) == 0) ? -1 : slot + 1 + this->Random(slot_count - slot);
+        this->no_jumps += ((generated.target == -1) ? 1 : 0) + ((generated.other == -1) ? 1 : 0);
+        break;
+      }
+      case eINST_JUMP: {
+        generated.target = slot + 1 + this->Random(slot_count - slot);
+        break;
+      }
+      case eINST_JSUB: {
+        this->instruction_hits[eINST_RETURN]++;
+        generated.target = 1 + this->Random(CONFORM_ROUTINES);
+        break;
+      }
+      case eINST_PUSH: {
+        this->Add_Read(words);
+        depth++;
+        break;
+      }
+      case eINST_POP: {
+        this->Add_Write(words);
+        depth--;
+        break;
+      }
+      case eINST_HALT:
+      case eINST_TRAP: {
+        break;
+      }
+      case eINST_INTERRUPT: {
+        words.push_back(this->Random(eINTERRUPT_TIMEOUT + 1));
+        break;
+      }
+      case eINST_SPAWN: {
+        this->instruction_hits[eINST_JOIN]++;
+        generated.target = 1 + CONFORM_ROUTINES + this->Random(CONFORM_ROUTINES);
+        break;
+      }
+      case eINST_CAS: {
+        this->Add_Range(words, 1);
+        this->Add_Read(words);
+        this->Add_Read(words);
+        this->Add_Write(words);
+        break;
+      }
+      case eINST_FETCH_ADD: {
+        this->Add_Range(words, 1);
+        this->Add_Read(words);
+        this->Add_Write(words);
+        break;
+      }
+      case eINST_FILL: {
+        int count = this->Random(33);
+        this->Add_Range(words, count);
+        this->Add_Read(words);
+        words.push_back(eADDRESS_VALUE);
+        words.push_back(count);
+        break;
+      }
+      case eINST_MOVE: {
+        int count = this->Random(33);
+        this->Add_Range(words, count);
+        this->Add_Range(words, count);
+        words.push_back(eADDRESS_VALUE);
+        words.push_back(count);
+        break;
+      }
+      case eINST_COMPARE: {
+        int count = this->Random(33);
+        this->Add_Range(words, count);
+        this->Add_Range(words, count);
+        words.push_back(eADDRESS_VALUE);
+        words.push_back(count);
+        this->Add_Write(words);
+        break;
+      }
+      default: {
+        if ((instruction >= eINST_VADD) && (instruction <= eINST_VOR_SCALAR)) {
+          int count = this->Random(33);
+          this->Add_Range(words, count);
+          if (instruction >= eINST_VADD_SCALAR) {
+            this->Add_Read(words);
+          }
+          else {
+            this->Add_Range(words, count);
+          }
+          this->Add_Range(words, count);
+          words.push_back(eADDRESS_VALUE);
+          words.push_back(count);
+        }
+        else { // Two numbers in and one out.
+          this->Add_Read(words);
+          this->Add_Read(words);
+          this->Add_Write(words);
+        }
+      }
+    }
+    return generated;
+  }
+
+  /**
+   * Gets a random number.
+   * @param count The number of possible numbers.
+   * @return A number from 0 to count - 1.
+   */
+  int cConformance::Random(int count) {
+    return (int)(this->random() % (unsigned int)count);
+  }
+
+  /**
+   * Gets a random value. Edge cases come up often.
+   * @return The value.
+   */
+  int cConformance::Random_Value() {
+    int values[10] = { 0, 1, -1, 2, 31, 32, 33, -32, 2147483647, (int)0x80000000 };
+    int pick = this->Random(13);
+    if (pick < 10) {
+      return values[pick];
+    }
+    if (pick < 12) {
+      return this->Random(200) - 100;
+    }
+    return (int)this->random();
+  }
+
+  /**
+   * Adds an operand that is read.
+   * @param words The words of the instruction.
+   */
+  void cConformance::Add_Read(std::vector<int>& words) {
+    int mode = this->Random(eADDRESS_POINTER + 1);
+    this->mode_hits[mode]++;
+    words.push_back(mode);
+    switch (mode) {
+      case eADDRESS_VALUE: words.push_back(this->Random_Value()); break;
+      case eADDRESS_IMMEDIATE: words.push_back(CONFORM_DATA + this->Random(CONFORM_DATA_SIZE)); break;
+      default: words.push_back(CONFORM_POINTERS + this->Random(CONFORM_POINTER_COUNT)); break;
+    }
   }
 
   /**
-   * Saves the program in the memory to a file.
-   * @param name The name of the file.
-   * @throws An error if the program could not be saved.
+   * Adds an operand that is written.
+   * @param words The words of the instruction.
    */
-  void cSimulator::Save_Program(std::string name) {
-    cFile prgm_file(name + ".prgm");
-    for (int mem_index = 0; mem_index < this->memory->count; mem_index++) {
-      prgm_file.Add(this->memory->Read_Number(mem_index));
+  void cConformance::Add_Write(std::vector<int>& words) {
+    int mode = (this->Random(2) == 0) ? eADDRESS_IMMEDIATE : eADDRESS_POINTER;
+    this->mode_hits[mode]++;
+    words.push_back(mode);
+    if (mode == eADDRESS_IMMEDIATE) {
+      words.push_back(CONFORM_DATA + this->Random(CONFORM_DATA_SIZE));
+    }
+    else {
+      words.push_back(CONFORM_POINTERS + this->Random(CONFORM_POINTER_COUNT));
+      this->pointer_writes++;
     }
-    prgm_file.Write();
   }
 
   /**
-   * Steps through a single instruction execution.
-   * @throws An error if the instruction is invalid.
+   * Adds the first address of a range as a value. Once in a while the range
+   * runs off the end of memory.
+   * @param words The words of the instruction.
+   * @param count The number of units in the range.
    */
-  void cSimulator::Step() {
-    int instruction = this->memory->Read_Number(this->pc++);
-    // std::cout << "instruction=" << instruction << ", pc=" << (this->pc - 1) << std::endl;
-    switch (instruction) {
-      case eINST_COPY: {
-        int value = this->Fetch_From_Address();
-        this->Write_To_Address(value);
+  void cConformance::Add_Range(std::vector<int>& words, int count) {
+    this->mode_hits[eADDRESS_VALUE]++;
+    words.push_back(eADDRESS_VALUE);
+    if (this->Random(500) == 0) {
+      words.push_back(this->memory_size - count + 1 + this->Random(4));
+    }
+    else {
+      words.push_back(CONFORM_DATA + this->Random(CONFORM_DATA_SIZE - count + 1));
+    }
+  }
+
+  /**
+   * Puts a program into a memory image.
+   * @param program The program.
+   * @param addresses The address of each instruction in each routine. The
+   * last address of a routine is its halt or return.
+   * @return The memory image.
+   * @throws An error if the program does not fit.
+   */
+  std::vector<int> cConformance::Encode(sConform_Program& program, std::vector<std::vector<int> >& addresses) {
+    std::vector<int> image(this->memory_size, 0);
+    image[eINTERRUPT_SCREEN] = this->screen;
+    image[eINTERRUPT_INPUT] = 3;
+    image[eINTERRUPT_TIMEOUT] = 4; // Holds a delay of zero.
+    for (int pointer_index = 0; pointer_index < CONFORM_POINTER_COUNT; pointer_index++) {
+      image[CONFORM_POINTERS + pointer_index] = program.pointers[pointer_index];
+    }
+    for (int data_index = 0; data_index < CONFORM_DATA_SIZE; data_index++) {
+      image[CONFORM_DATA + data_index] = program.data[data_index];
+    }
+    int routine_count = (int)program.routines.size();
+    addresses.assign(routine_count, std::vector<int>());
+    int pointer = CONFORM_CODE;
+    for (int routine = 0; routine < routine_count; routine++) {
+      int slot_count = (int)program.routines[routine].size();
+      for (int slot = 0; slot < slot_count; slot++) {
+        sGenerated& generated = program.routines[routine][slot];
+        addresses[routine].push_back(pointer);
+        switch (generated.instruction) {
+          case eINST_TEST: pointer += 8; break;
+          case eINST_JUMP: pointer += 2; break;
+          case eINST_JSUB: pointer += 3; break;
+          case eINST_SPAWN: pointer += 10; break;
+          default: pointer += 1 + (int)generated.words.size();
+        }
+      }
+      addresses[routine].push_back(pointer++); // Halt or return.
+    }
+    if (pointer > CONFORM_MEMORY) {
+      throw cError("Generated program is too big.");
+    }
+    for (int routine = 0; routine < routine_count; routine++) {
+      int slot_count = (int)program.routines[routine].size();
+      for (int slot = 0; slot < slot_count; slot++) {
+        sGenerated& generated = program.routines[routine][slot];
+        pointer = addresses[routine][slot];
+        image[pointer++] = generated.instruction;
+        if (generated.instruction == eINST_JSUB) {
+          image[pointer++] = eADDRESS_VALUE;
+          image[pointer++] = addresses[generated.target][0];
+        }
+        else if (generated.instruction == eINST_SPAWN) {
+          int spawn[9] = { eADDRESS_VALUE, addresses[generated.target][0], eADDRESS_VALUE, CONFORM_THREAD_STACK, eADDRESS_IMMEDIATE, 5, eINST_JOIN, eADDRESS_IMMEDIATE, 5 };
+          for (int word_index = 0; word_index < 9; word_index++) {
+            image[pointer++] = spawn[word_index];
+          }
+        }
+        for (int word_index = 0; word_index < (int)generated.words.size(); word_index++) {
+          image[pointer++] = generated.words[word_index];
+        }
+        if (generated.instruction == eINST_JUMP) {
+          image[pointer++] = addresses[routine][generated.target];
+        }
+        else if (generated.instruction == eINST_TEST) {
+          image[pointer++] = (generated.target == -1) ? TAKE_NO_JUMP : addresses[routine][generated.target];
+          image[pointer++] = (generated.other == -1) ? TAKE_NO_JUMP : addresses[routine][generated.other];
+        }
+      }
+      bool subroutine = (routine > 0) && (routine <= CONFORM_ROUTINES);
+      image[addresses[routine][slot_count]] = subroutine ? eINST_RETURN : eINST_HALT;
+    }
+    return image;
+  }
+
+  /**
+   * Runs a program on the model and every engine and compares them after
+   * each batch.
+   * @param program The program.
+   * @return What was different or blank if everything matched.
+   */
+  std::string cConformance::Check(sConform_Program& program) {
+    std::vector<std::vector<int> > addresses;
+    std::vector<int> model_memory = this->Encode(program, addresses);
+    sModel_Thread model = { CONFORM_CODE, CONFORM_STACK, eSTATUS_RUNNING, false };
+    long long model_count = 0;
+    this->model_threads.clear();
+    // The first engine steps by itself and the rest run slices.
+    int engine_count = 1 + (int)this->levels.size();
+    std::vector<cHeadless_IO*> ios;
+    std::vector<cSimulator*> simulators;
+    std::vector<bool> failed(engine_count, false);
+    std::vector<std::string> names(1, "step");
+    for (int level_index = 0; level_index < (int)this->levels.size(); level_index++) {
+      const char* level_names[3] = { "scalar", "sse4", "avx2" };
+      names.push_back(std::string("slice/") + level_names[this->levels[level_index]]);
+    }
+    for (int engine = 0; engine < engine_count; engine++) {
+      cHeadless_IO* io = new cHeadless_IO();
+      cSimulator* simulator = new cSimulator(io, "Config");
+      delete simulator->memory;
+      simulator->memory = new cMemory(this->memory_size);
+      std::memcpy(simulator->memory->memory, &model_memory[0], this->memory_size * sizeof(int));
+      simulator->pc = CONFORM_CODE;
+      simulator->sp = CONFORM_STACK;
+      simulator->interrupt_pointer = 0;
+      simulator->status = eSTATUS_RUNNING;
+      ios.push_back(io);
+      simulators.push_back(simulator);
+    }
+    std::string message = "";
+    while (message.length() == 0) {
+      // Run the model. A thread is always joined in the same batch.
+      int steps = 0;
+      bool spawned = false;
+      while ((model.status == eSTATUS_RUNNING) && !model.failed && ((steps < CONFORM_BATCH) || spawned)) {
+        spawned = (model.pc >= 0) && (model.pc < this->memory_size) && (model_memory[model.pc] == eINST_SPAWN);
+        try {
+          this->Model_Step(model_memory, model);
+        }
+        catch (cError error) {
+          model.failed = true;
+        }
+        steps++;
+        model_count++;
+      }
+      // Run the engines.
+      for (int engine = 0; engine < engine_count; engine++) {
+        cSimulator* simulator = simulators[engine];
+        Set_Vector_Level((engine == 0) ? eVECTOR_SCALAR : this->levels[engine - 1]);
+        long long target = simulator->instructions + CONFORM_BATCH;
+        try {
+          while ((simulator->status == eSTATUS_RUNNING) && !failed[engine] && ((simulator->instructions < target) || Has_Running_Thread(simulator))) {
+            if (engine == 0) {
+              simulator->Step();
+              simulator->instructions++;
+            }
+            else {
+              simulator->spinning = false; // Only tells the host to wait.
+              simulator->spin_count = 0;
+              simulator->Run_Slice((int)std::max(1LL, target - simulator->instructions));
+            }
+          }
+        }
+        catch (cError error) {
+          failed[engine] = true;
+        }
+      }
+      // Compare everything to the model.
+      for (int engine = 0; (engine < engine_count) && (message.length() == 0); engine++) {
+        cSimulator* simulator = simulators[engine];
+        if (failed[engine] != model.failed) {
+          message = names[engine] + (failed[engine] ? " failed" : " did not fail") + " by instruction " + std::to_string(model_count) + ".";
+        }
+        else if (std::memcmp(simulator->memory->memory, &model_memory[0], this->memory_size * sizeof(int)) != 0) {
+          int address = 0;
+          while (simulator->memory->memory[address] == model_memory[address]) {
+            address++;
+          }
+          message = names[engine] + " has " + Number_To_Text(simulator->memory->memory[address]) + " at " + Number_To_Text(address) + " but the model has " + Number_To_Text(model_memory[address]) + " by instruction " + std::to_string(model_count) + ".";
+        }
+        else if (!model.failed && ((simulator->pc != model.pc) || (simulator->sp != model.sp) || (simulator->status != model.status) || (simulator->instructions != model_count))) {
+          message = names[engine] + " has pc=" + Number_To_Text(simulator->pc) + ", sp=" + Number_To_Text(simulator->sp) + ", status=" + Number_To_Text(simulator->status) + " but the model has pc=" + Number_To_Text(model.pc) + ", sp=" + Number_To_Text(model.sp) + ", status=" + Number_To_Text(model.status) + " by instruction " + std::to_string(model_count) + ".";
+        }
+      }
+      if ((model.status != eSTATUS_RUNNING) || model.failed) {
         break;
       }
-      case eINST_ADD: {
-        int left = this->Fetch_From_Address();
-        int right = this->Fetch_From_Address();
-        this->Write_To_Address(left + right);
+      if (model_count > CONFORM_STEP_LIMIT) {
+        message = "Program did not end.";
+      }
+    }
+    for (int engine = 0; engine < engine_count; engine++) {
+      delete simulators[engine];
+      delete ios[engine];
+    }
+    return message;
+  }
+
+  /**
+   * Runs one instruction on the model. The model is written from the rules
+   * of the machine and does not share code with the simulator.
+   * @param memory The model memory.
+   * @param thread The registers of the thread.
+   * @throws An error if the instruction fails.
+   */
+  void cConformance::Model_Step(std::vector<int>& memory, sModel_Thread& thread) {
+    int instruction = this->Model_Read(memory, thread.pc++);
+    if ((instruction >= eINST_VADD) && (instruction <= eINST_VOR_SCALAR)) {
+      bool scalar = (instruction >= eINST_VADD_SCALAR);
+      int operations[5] = { eINST_ADD, eINST_SUB, eINST_MUL, eINST_AND, eINST_OR };
+      int operation = operations[(instruction - eINST_VADD) % 5];
+      int left = this->Model_Fetch(memory, thread);
+      int right = this->Model_Fetch(memory, thread);
+      int destination = this->Model_Fetch(memory, thread);
+      int count = this->Model_Fetch(memory, thread);
+      this->Model_Range(memory, left, count);
+      if (!scalar) {
+        this->Model_Range(memory, right, count);
+      }
+      this->Model_Range(memory, destination, count);
+      for (int index = 0; index < count; index++) {
+        unsigned int a = (unsigned int)memory[left + index];
+        unsigned int b = (unsigned int)(scalar ? right : memory[right + index]);
+        unsigned int result = 0;
+        switch (operation) {
+          case eINST_ADD: result = a + b; break;
+          case eINST_SUB: result = a - b; break;
+          case eINST_MUL: result = a * b; break;
+          case eINST_AND: result = a & b; break;
+          default: result = a | b;
+        }
+        memory[destination + index] = (int)result;
+      }
+      return;
+    }
+    switch (instruction) {
+      case eINST_COPY: {
+        this->Model_Store(memory, thread, this->Model_Fetch(memory, thread));
         break;
       }
-      case eINST_SUB: {
-        int left = this->Fetch_From_Address();
-        int right = this->Fetch_From_Address();
-        this->Write_To_Address(left - right);
+      case eINST_ADD:
+      case eINST_SUB:
+      case eINST_MUL:
+      case eINST_DIV:
+      case eINST_AND:
+      case eINST_OR:
+      case eINST_MOD:
+      case eINST_XOR:
+      case eINST_SHL:
+      case eINST_SHR: {
+        int left = this->Model_Fetch(memory, thread);
+        int right = this->Model_Fetch(memory, thread);
+        unsigned int a = (unsigned int)left;
+        unsigned int b = (unsigned int)right;
+        int result = 0;
+        switch (instruction) {
+          case eINST_ADD: result = (int)(a + b); break;
+          case eINST_SUB: result = (int)(a - b); break;
+          case eINST_MUL: result = (int)(a * b); break;
+          case eINST_AND: result = left & right; break;
+          case eINST_OR: result = left | right; break;
+          case eINST_XOR: result = left ^ right; break;
+          case eINST_DIV: {
+            // Dividing by zero leaves the number alone.
+            result = (right == 0) ? left : ((right == -1) ? (int)(0u - a) : (left / right));
+            break;
+          }
+          case eINST_MOD: {
+            result = ((right == 0) ? left : ((right == -1) ? 0 : (left % right)));
+            break;
+          }
+          default: {
+            // A negative count shifts the other way and big counts shift
+            // everything out. Shifting right keeps the sign.
+            long long count = (instruction == eINST_SHL) ? (long long)right : -(long long)right;
+            if (count >= 32) {
+              result = 0;
+            }
+            else if (count >= 0) {
+              result = (int)(a << count);
+            }
+            else if (count <= -32) {
+              result = (left < 0) ? -1 : 0;
+            }
+            else {
+              result = (int)((long long)left >> -count);
+            }
+          }
+        }
+        this->Model_Store(memory, thread, result);
         break;
       }
-      case eINST_MUL: {
-        int left = this->Fetch_From_Address();
-        int right = this->Fetch_From_Address();
-        this->Write_To_Address(left * right);
+      case eINST_NOT: {
+        this->Model_Store(memory, thread, ~this->Model_Fetch(memory, thread));
         break;
       }
-      case eINST_DIV: {
-        int left = this->Fetch_From_Address();
-        int right = this->Fetch_From_Address();
-        if (right == 0) {
-          this->Write_To_Address(left); // Do not divide!
-        }
-        else {
-          this->Write_To_Address(left / right);
-        }
+      case eINST_MAC: {
+        int left = this->Model_Fetch(memory, thread);
+        int right = this->Model_Fetch(memory, thread);
+        int pc = thread.pc;
+        int total = this->Model_Fetch(memory, thread);
+        thread.pc = pc;
+        this->Model_Store(memory, thread, (int)((unsigned int)total + ((unsigned int)left * (unsigned int)right)));
         break;
       }
       case eINST_TEST: {
-        bool result = this->Eval_Test();
-        int passed_addr = this->Fetch_Number();
-        int failed_addr = this->Fetch_Number();
-        // std::cout << "passed=" << passed_addr << ", failed=" << failed_addr << std::endl;
-        // if (failed_addr == 1) {
-        //   std::cout << "Yes! It is really 1!" << std::endl;
-        // }
-        if (result) {
-          if (passed_addr != TAKE_NO_JUMP) { // Jumps do not need to be taken.
-            this->pc = passed_addr;
-          }
+        int left = this->Model_Fetch(memory, thread);
+        int test = this->Model_Read(memory, thread.pc++);
+        int right = this->Model_Fetch(memory, thread);
+        // The test reads right to left so > passes when right is bigger.
+        long long difference = (long long)right - (long long)left; // Cannot overflow.
+        bool passed = false;
+        switch (test) {
+          case eTEST_EQUALS: passed = (difference == 0); break;
+          case eTEST_NOT: passed = (difference != 0); break;
+          case eTEST_GREATER: passed = (difference > 0); break;
+          case eTEST_LESS: passed = (difference < 0); break;
+          case eTEST_GREATER_OR_EQUAL: passed = (difference >= 0); break;
+          case eTEST_LESS_OR_EQUAL: passed = (difference <= 0); break;
+          default: throw cError("Invalid test.");
         }
-        else {
-          if (failed_addr != TAKE_NO_JUMP) {
-            this->pc = failed_addr;
-          }
+        int pass = this->Model_Read(memory, thread.pc++);
+        int fail = this->Model_Read(memory, thread.pc++);
+        int address = passed ? pass : fail;
+        if (address != TAKE_NO_JUMP) {
+          thread.pc = address;
         }
         break;
       }
       case eINST_JUMP: {
-        int address = this->Fetch_Number();
-        this->pc = address;
+        thread.pc = this->Model_Read(memory, thread.pc);
         break;
       }
       case eINST_JSUB: {
-        int address = this->Fetch_From_Address();
-        // std::cout << "jsub=" << address << std::endl;
-        this->Push(this->pc); // Push the value to the next instruction after the JSUB.
-        this->pc = address;
+        int address = this->Model_Fetch(memory, thread);
+        this->Model_Write(memory, thread.sp++, thread.pc);
+        thread.pc = address;
         break;
       }
       case eINST_PUSH: {
-        int value = this->Fetch_From_Address();
-        this->Push(value);
+        int value = this->Model_Fetch(memory, thread);
+        this->Model_Write(memory, thread.sp++, value);
         break;
       }
       case eINST_POP: {
-        int value = this->Pop();
-        this->Write_To_Address(value);
+        thread.sp--;
+        this->Model_Store(memory, thread, this->Model_Read(memory, thread.sp));
         break;
       }
       case eINST_RETURN: {
-        int address = this->Pop(); // Get address to return to.
-        this->pc = address;
+        thread.sp--;
+        thread.pc = this->Model_Read(memory, thread.sp);
         break;
       }
-      case eINST_AND: {
-        int left = this->Fetch_From_Address();
-        int right = this->Fetch_From_Address();
-        this->Write_To_Address(left & right);
+      case eINST_HALT: {
+        thread.status = eSTATUS_IDLE;
         break;
       }
-      case eINST_OR: {
-        int left = this->Fetch_From_Address();
-        int right = this->Fetch_From_Address();
-        this->Write_To_Address(left | right);
+      case eINST_INTERRUPT: {
+        int interrupt = this->Model_Read(memory, thread.pc++);
+        int pointer = this->Model_Read(memory, interrupt);
+        if (interrupt == eINTERRUPT_INPUT) {
+          this->Model_Write(memory, pointer, 0); // No keys are pressed.
+        }
+        else if (interrupt == eINTERRUPT_SCREEN) {
+          this->Model_Range(memory, pointer, this->grid_size);
+        }
+        else if (interrupt == eINTERRUPT_TIMEOUT) {
+          this->Model_Read(memory, pointer);
+        }
+        else {
+          throw cError("Invalid interrupt.");
+        }
         break;
       }
-      case eINST_HALT: {
-        this->status = eSTATUS_IDLE;
+      case eINST_SPAWN: {
+        sModel_Thread child = { this->Model_Fetch(memory, thread), 0, eSTATUS_RUNNING, false };
+        child.sp = this->Model_Fetch(memory, thread);
+        try {
+          for (int step = 0; (step < CONFORM_STEP_LIMIT) && (child.status == eSTATUS_RUNNING); step++) {
+            this->Model_Step(memory, child);
+          }
+        }
+        catch (cError error) {
+          child.failed = true;
+        }
+        // Slots hold 0 when free, 1 when the thread halted and 2 when it
+        // failed. Joined slots are used again.
+        int slot = 0;
+        while ((slot < (int)this->model_threads.size()) && (this->model_threads[slot] != 0)) {
+          slot++;
+        }
+        if (slot == (int)this->model_threads.size()) {
+          this->model_threads.push_back(0);
+        }
+        this->model_threads[slot] = child.failed ? 2 : 1;
+        this->Model_Store(memory, thread, slot + 1);
         break;
       }
-      case eINST_INTERRUPT: {
-        int interrupt = this->Fetch_Number();
-        this->Process_Interrupt(interrupt);
+      case eINST_JOIN: {
+        int number = this->Model_Fetch(memory, thread);
+        if ((number < 1) || (number > (int)this->model_threads.size()) || (this->model_threads[number - 1] == 0)) {
+          throw cError("Invalid join.");
+        }
+        bool failed = (this->model_threads[number - 1] == 2);
+        this->model_threads[number - 1] = 0;
+        if (failed) {
+          throw cError("Thread failed.");
+        }
+        break;
+      }
+      case eINST_CAS: {
+        int address = this->Model_Fetch(memory, thread);
+        int expected = this->Model_Fetch(memory, thread);
+        int value = this->Model_Fetch(memory, thread);
+        int old = this->Model_Read(memory, address);
+        if (old == expected) {
+          this->Model_Write(memory, address, value);
+        }
+        this->Model_Store(memory, thread, old);
+        break;
+      }
+      case eINST_FETCH_ADD: {
+        int address = this->Model_Fetch(memory, thread);
+        int amount = this->Model_Fetch(memory, thread);
+        int old = this->Model_Read(memory, address);
+        this->Model_Write(memory, address, (int)((unsigned int)old + (unsigned int)amount));
+        this->Model_Store(memory, thread, old);
+        break;
+      }
+      case eINST_FILL: {
+        int address = this->Model_Fetch(memory, thread);
+        int value = this->Model_Fetch(memory, thread);
+        int count = this->Model_Fetch(memory, thread);
+        this->Model_Range(memory, address, count);
+        for (int index = 0; index < count; index++) {
+          memory[address + index] = value;
+        }
+        break;
+      }
+      case eINST_MOVE: {
+        int source = this->Model_Fetch(memory, thread);
+        int destination = this->Model_Fetch(memory, thread);
+        int count = this->Model_Fetch(memory, thread);
+        this->Model_Range(memory, source, count);
+        this->Model_Range(memory, destination, count);
+        std::vector<int> copy(memory.begin() + source, memory.begin() + source + count);
+        for (int index = 0; index < count; index++) {
+          memory[destination + index] = copy[index];
+        }
+        break;
+      }
+      case eINST_COMPARE: {
+        int left = this->Model_Fetch(memory, thread);
+        int right = this->Model_Fetch(memory, thread);
+        int count = this->Model_Fetch(memory, thread);
+        this->Model_Range(memory, left, count);
+        this->Model_Range(memory, right, count);
+        int result = 0;
+        for (int index = 0; (index < count) && (result == 0); index++) {
+          if (memory[left + index] != memory[right + index]) {
+            result = (memory[left + index] < memory[right + index]) ? -1 : 1;
+          }
+        }
+        this->Model_Store(memory, thread, result);
         break;
       }
       default: {
-        this->status = eSTATUS_ERROR;
-        throw cError("Invalid instruction at " + Number_To_Text(this->pc) + ": " + Number_To_Text(instruction));
+        throw cError("Invalid instruction.");
       }
     }
   }
 
   /**
-   * Runs the simulator for a certain amount of time before it gives up control.
-   * @param timeout The amount of time to run the simulator in milliseconds.
+   * Reads a number from the model memory.
+   * @param memory The model memory.
+   * @param address The address.
+   * @return The number.
+   * @throws An error if the address is outside the memory.
    */
-  void cSimulator::Run(int timeout) {
-    std::clock_t start = std::clock();
-    while (this->status == eSTATUS_RUNNING) {
-      std::clock_t end = std::clock();
-      std::clock_t diff = (end - start) / CLOCKS_PER_SEC * 1000;
-      if ((int)diff < timeout) {
-        this->Step();
-      }
-      else {
-        break; // Time is up, break out!
-      }
+  int cConformance::Model_Read(std::vector<int>& memory, int address) {
+    if ((address < 0) || (address >= (int)memory.size())) {
+      throw cError("Invalid read.");
     }
+    return memory[address];
   }
 
   /**
-   * Fetches a number from the memory.
-   * @return The fetched number.
-   * @throws An error if the number could not be fetched.
+   * Writes a number to the model memory.
+   * @param memory The model memory.
+   * @param address The address.
+   * @param value The number.
+   * @throws An error if the address is outside the memory.
    */
-  int cSimulator::Fetch_Number() {
-    return this->memory->Read_Number(this->pc++);
+  void cConformance::Model_Write(std::vector<int>& memory, int address, int value) {
+    if ((address < 0) || (address >= (int)memory.size())) {
+      throw cError("Invalid write.");
+    }
+    memory[address] = value;
   }
 
   /**
-   * Puts a number on the memory.
-   * @param number The number to put.
-   * @throws An error if there is an invalid memory access.
+   * Checks that a range is inside the model memory.
+   * @param memory The model memory.
+   * @param address The first address.
+   * @param count The number of units.
+   * @throws An error if the range is not in the memory.
    */
-  void cSimulator::Put_Number(int number) {
-    this->memory->Write_Number(this->pc++, number);
+  void cConformance::Model_Range(std::vector<int>& memory, int address, int count) {
+    if ((count < 0) || (address < 0) || ((long long)address + count > (long long)memory.size())) {
+      throw cError("Invalid range.");
+    }
   }
 
   /**
-   * Fetches a number from an address.
-   * @return The fetched number.
-   * @throws An error if the number could not be fetched.
+   * Reads an operand.
+   * @param memory The model memory.
+   * @param thread The registers of the thread.
+   * @return The value of the operand.
+   * @throws An error if the operand is invalid.
    */
-  int cSimulator::Fetch_From_Address() {
-    int number = 0;
-    int addr_mode = this->memory->Read_Number(this->pc++);
-    int address = this->memory->Read_Number(this->pc++);
-    switch (addr_mode) {
-      case eADDRESS_VALUE: {
-        number = address; // Address is the value.
-        break;
-      }
-      case eADDRESS_IMMEDIATE: {
-        number = this->memory->Read_Number(address);
-        break;
-      }
-      case eADDRESS_POINTER: {
-        int pointer = this->memory->Read_Number(address);
-        number = this->memory->Read_Number(pointer);
-        break;
-      }
-      default: {
-        this->status = eSTATUS_ERROR;
-        throw cError("Invalid address mode " + Number_To_Text(addr_mode) + " for read.");
-      }
+  int cConformance::Model_Fetch(std::vector<int>& memory, sModel_Thread& thread) {
+    int mode = this->Model_Read(memory, thread.pc++);
+    int address = this->Model_Read(memory, thread.pc++);
+    switch (mode) {
+      case eADDRESS_VALUE: return address;
+      case eADDRESS_IMMEDIATE: return this->Model_Read(memory, address);
+      case eADDRESS_POINTER: return this->Model_Read(memory, this->Model_Read(memory, address));
     }
-    return number;
+    throw cError("Invalid read mode.");
   }
 
   /**
-   * Writes a value to the memory at the given address.
-   * @param value The value to write to memory.
-   * @throws An error if the address mode is invalid. You cannot have a value address mode.
+   * Writes to an operand.
+   * @param memory The model memory.
+   * @param thread The registers of the thread.
+   * @param value The value to write.
+   * @throws An error if the operand is invalid.
    */
-  void cSimulator::Write_To_Address(int value) {
-    int addr_mode = this->memory->Read_Number(this->pc++);
-    int address = this->memory->Read_Number(this->pc++);
-    switch (addr_mode) {
+  void cConformance::Model_Store(std::vector<int>& memory, sModel_Thread& thread, int value) {
+    int mode = this->Model_Read(memory, thread.pc++);
+    int address = this->Model_Read(memory, thread.pc++);
+    switch (mode) {
       case eADDRESS_IMMEDIATE: {
-        this->memory->Write_Number(address, value);
+        this->Model_Write(memory, address, value);
         break;
       }
       case eADDRESS_POINTER: {
-        int pointer = this->memory->Read_Number(address);
-        this->memory->Write_Number(pointer, value);
+        this->Model_Write(memory, this->Model_Read(memory, address), value);
         break;
       }
       default: {
-        this->status = eSTATUS_ERROR;
-        throw cError("Invalid address mode " + Number_To_Text(addr_mode) + " for write.");
+        throw cError("Invalid write mode.");
       }
     }
   }
 
   /**
-   * Evaluates a test for the command.
-   * @return True if the test passed, false if it failed.
-   * @throws An error if the test is invalid.
+   * Takes out instructions one at a time while the engines still disagree.
+   * @param program The program to shrink.
    */
-  bool cSimulator::Eval_Test() {
-    int left = this->Fetch_From_Address();
-    int test = this->Fetch_Number();
-    int right = this->Fetch_From_Address();
-    bool result = false;
-    int diff = right - left;
-    switch (test) {
-      case eTEST_EQUALS: {
-        result = (diff == 0);
-        break;
-      }
-      case eTEST_NOT: {
-        result = (diff != 0);
-        break;
-      }
-      case eTEST_GREATER: {
-        result = (diff > 0);
-        break;
-      }
-      case eTEST_LESS: {
-        result = (diff < 0);
-        break;
-      }
-      case eTEST_GREATER_OR_EQUAL: {
-        result = (diff >= 0);
-        break;
-      }
-      case eTEST_LESS_OR_EQUAL: {
-        result = (diff <= 0);
-        break;
-      }
-      default: {
-        this->status = eSTATUS_ERROR;
-        throw cError("Invalid test " + Number_To_Text(test) + ".");
+  void cConformance::Shrink(sConform_Program& program) {
+    bool shrunk = true;
+    while (shrunk) {
+      shrunk = false;
+      int routine_count = (int)program.routines.size();
+      for (int routine = 0; routine < routine_count; routine++) {
+        for (int slot = (int)program.routines[routine].size() - 1; slot >= 0; slot--) {
+          sConform_Program candidate = program;
+          std::vector<sGenerated>& instructions = candidate.routines[routine];
+          instructions.erase(instructions.begin() + slot);
+          // Jumps past the instruction move back by one.
+          int instruction_count = (int)instructions.size();
+          for (int instruction_index = 0; instruction_index < instruction_count; instruction_index++) {
+            sGenerated& generated = instructions[instruction_index];
+            if ((generated.instruction == eINST_JUMP) || (generated.instruction == eINST_TEST)) {
+              generated.target -= (generated.target > slot) ? 1 : 0;
+              generated.other -= (generated.other > slot) ? 1 : 0;
+            }
+          }
+          if (this->Check(candidate).length() > 0) {
+            program = candidate;
+            shrunk = true;
+          }
+        }
       }
     }
-    return result;
   }
 
   /**
-   * Pushes a value onto the stack.
-   * @param value The value to push onto the stack.
-   * @throws An error if an invalid memory location is accessed.
+   * Saves a failing program so it can be looked at. Conform.prgm holds the
+   * memory image and Conform.fail.txt lists the instructions.
+   * @param program The program.
+   * @param message What was different.
+   * @throws An error if the files could not be written.
    */
-  void cSimulator::Push(int value) {
-    this->memory->Write_Number(this->sp++, value);
+  void cConformance::Save_Failure(sConform_Program& program, std::string message) {
+    std::vector<std::vector<int> > addresses;
+    std::vector<int> image = this->Encode(program, addresses);
+    std::ofstream prgm_file("Conform.prgm");
+    std::ofstream report("Conform.fail.txt");
+    if (!prgm_file || !report) {
+      throw cError("Could not save the failing program.");
+    }
+    for (int address = 0; address < this->memory_size; address++) {
+      prgm_file << image[address] << std::endl;
+    }
+    report << message << std::endl;
+    report << "memory=" << this->memory_size << ", program=" << CONFORM_CODE << ", stack=" << CONFORM_STACK << ", interrupt=0" << std::endl;
+    int routine_count = (int)program.routines.size();
+    for (int routine = 0; routine < routine_count; routine++) {
+      report << ((routine == 0) ? "Main" : ((routine <= CONFORM_ROUTINES) ? "Subroutine" : "Thread")) << std::endl;
+      int slot_count = (int)program.routines[routine].size();
+      for (int slot = 0; slot <= slot_count; slot++) {
+        int address = addresses[routine][slot];
+        int end = (slot < slot_count) ? addresses[routine][slot + 1] : address + 1;
+        report << "  " << address << ": " << Get_Instruction_Name(image[address]);
+        for (int word_index = address + 1; word_index < end; word_index++) {
+          report << " " << image[word_index];
+        }
+        report << std::endl;
+      }
+    }
   }
 
+  // **************************************************************************
+  // Benchmark Implementation
+  // **************************************************************************
+
   /**
-   * Pops a value off of the stack.
-   * @return The value from the stack.
-   * @throws An error if an invalid memory location is accessed.
+   * Creates a benchmark for a suite of programs. The programs share the
+   * config file that sits in the same folder as the suite list.
+   * @param suite The name of the suite list with one program per line.
+   * @throws An error if the suite could not be loaded.
    */
-  int cSimulator::Pop() {
-    return this->memory->Read_Number(--this->sp);
+  cBenchmark::cBenchmark(std::string suite) {
+    this->suite = suite;
+    size_t slash = suite.find_last_of("/\\");
+    this->folder = (slash == std::string::npos) ? "" : suite.substr(0, slash + 1);
+    this->config = this->folder + "Config";
+    cFile suite_file(suite + ".txt");
+    suite_file.Read();
+    while (suite_file.Has_More_Lines()) {
+      std::string name = suite_file.Get_Line();
+      if (name.length() > 0) {
+        this->programs.Push(name);
+      }
+    }
   }
 
   /**
-   * Processes an interrupt.
-   * @param interrupt The interrupt number.
-   * @throws An error if the interrupt is not recognized.
+   * Generates a large source file to time the assembler with.
+   * @param name The name of the source file.
+   * @param line_count The number of instruction lines to generate.
+   * @throws An error if the source could not be written.
    */
-  void cSimulator::Process_Interrupt(int interrupt) {
-    int pointer = this->memory->Read_Number(this->interrupt_pointer + interrupt);
-    switch (interrupt) {
-      case eINTERRUPT_INPUT: {
-        sSignal key = this->io->Read_Key();
-        this->memory->Write_Number(pointer, key.code); // Write out key.
-        break;
+  void cBenchmark::Generate_Source(std::string name, int line_count) {
+    std::ofstream source(name + ".asm");
+    if (!source) {
+      throw cError("Could not generate " + name + ".");
+    }
+    source << "Generated by the benchmark to time the assembler." << std::endl;
+    source << ":label Interrupt_Vector" << std::endl << ":list 3" << std::endl;
+    source << ":label Stack" << std::endl << ":list 20" << std::endl;
+    source << ":label Screen" << std::endl << ":list 450" << std::endl;
+    source << ":label Input" << std::endl << ":number 0" << std::endl;
+    source << ":label Timeout" << std::endl << ":number 0" << std::endl;
+    source << ":label Program" << std::endl;
+    for (int line_index = 0; line_index < line_count; line_index++) {
+      if ((line_index % 10) == 0) {
+        source << "Block number " << line_index << "." << std::endl;
+        source << ":label G." << line_index << std::endl;
       }
-      case eINTERRUPT_SCREEN: {
-        this->Draw_Screen(this->memory, pointer);
-        break;
+      switch (line_index % 4) {
+        case 0: source << ":add #[Total] $" << line_index << " #[Total]" << std::endl; break;
+        case 1: source << ":sub #[Total] $" << (line_index / 2) << " #[Total]" << std::endl; break;
+        case 2: source << ":and #[Total] $1048575 #[Total]" << std::endl; break;
+        case 3: source << ":test #[Total] = $-1 [G." << (line_index - (line_index % 10)) << "] {take-no-jump}" << std::endl; break;
       }
-      case eINTERRUPT_TIMEOUT: {
-        int delay = this->memory->Read_Number(pointer);
-        this->io->Timeout(delay);
-        break;
+    }
+    source << ":halt" << std::endl;
+    source << ":label Total" << std::endl << ":number 0" << std::endl;
+  }
+
+  /**
+   * Runs every program in the suite several times and reports the results.
+   * The results are also written to a CSV file next to the suite.
+   * @throws An error if a program fails.
+   */
+  void cBenchmark::Run() {
+    this->Generate_Source(this->folder + "Generated", BENCH_GENERATED_LINES);
+    this->results.open((this->suite + ".csv").c_str());
+    if (!this->results) {
+      throw cError("Could not write results for " + this->suite + ".");
+    }
+    this->results << "program,metric,median,minimum,maximum,deviation" << std::endl;
+    int program_count = this->programs.Count();
+    for (int program_index = 0; program_index < program_count; program_index++) {
+      this->Run_Program(this->programs[program_index]);
+    }
+  }
+
+  /**
+   * Compiles, loads, and runs a program headless several times.
+   * @param name The name of the program.
+   * @throws An error if the program fails or runs too long.
+   */
+  void cBenchmark::Run_Program(std::string name) {
+    std::vector<double> assembly_rates;
+    std::vector<double> save_times;
+    std::vector<double> load_times;
+    std::vector<double> instruction_rates;
+    std::vector<double> frame_rates;
+    for (int run_index = 0; run_index < BENCH_RUNS; run_index++) {
+      cHeadless_IO io;
+      // Assemble. Saving the program and map is timed on its own.
+      {
+        cSimulator simulator(&io, this->config);
+        cAssembler assembler(&simulator);
+        long long saved = metrics.counters[eMETRIC_SAVE_TIME];
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        assembler.Load_Source(name);
+        assembler.Compile_Source(name);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        double save_time = (metrics.counters[eMETRIC_SAVE_TIME] - saved) / 1e9;
+        assembly_rates.push_back(assembler.line_count / (elapsed.count() - save_time));
+        save_times.push_back(save_time * 1000);
       }
-      default: {
-        throw cError("Interrupt " + Number_To_Text(interrupt) + " is not defined.");
+      // Load.
+      cSimulator simulator(&io, this->config);
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      simulator.Load_Program(name);
+      std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+      load_times.push_back(elapsed.count() * 1000);
+      // Run.
+      start = std::chrono::steady_clock::now();
+      while ((simulator.status == eSTATUS_RUNNING) && !simulator.spinning && (simulator.instructions < BENCH_LIMIT)) {
+        simulator.Run_Slice(HOST_SLICE);
+      }
+      elapsed = std::chrono::steady_clock::now() - start;
+      if (simulator.status != eSTATUS_IDLE) {
+        throw cError(name + " did not halt.");
       }
+      instruction_rates.push_back(simulator.instructions / elapsed.count());
+      frame_rates.push_back(io.frames / elapsed.count());
     }
+    this->Report(name, "assembler-lines-per-second", assembly_rates);
+    this->Report(name, "save-milliseconds", save_times);
+    this->Report(name, "load-milliseconds", load_times);
+    this->Report(name, "instructions-per-second", instruction_rates);
+    this->Report(name, "frames-per-second", frame_rates);
   }
 
   /**
-   * Draws the character screen to the display.
-   * @param memory The memory where the screen is at.
-   * @param address The address of the screen.
+   * Reports statistics for a set of samples.
+   * @param name The name of the program.
+   * @param metric The name of what was measured.
+   * @param samples The measurements.
    */
-  void cSimulator::Draw_Screen(Codeloader::cMemory* memory, int address) {
-    int grid_w = this->width / this->letter_w;
-    int grid_h = this->height / this->letter_h;
-    this->io->Color(255, 255, 255); // Color screen to white.
-    for (int y = 0; y < grid_h; y++) {
-      for (int x = 0; x < grid_w; x++) {
-        int letter = memory->Read_Number(address + (y * grid_w) + x);
-        char buffer[2] = { (char)letter, 0 };
-        this->io->Output_Text(buffer, x * this->letter_w, y * this->letter_h, 0, 0, 255);
-      }
+  void cBenchmark::Report(std::string name, std::string metric, std::vector<double>& samples) {
+    std::sort(samples.begin(), samples.end());
+    int sample_count = samples.size();
+    double median = (sample_count % 2) ? samples[sample_count / 2] : (samples[sample_count / 2 - 1] + samples[sample_count / 2]) / 2;
+    double mean = 0;
+    for (int sample_index = 0; sample_index < sample_count; sample_index++) {
+      mean += samples[sample_index];
     }
-    // Draw screen to display.
-    this->io->Refresh();
+    mean /= sample_count;
+    double variance = 0;
+    for (int sample_index = 0; sample_index < sample_count; sample_index++) {
+      variance += (samples[sample_index] - mean) * (samples[sample_index] - mean);
+    }
+    double deviation = std::sqrt(variance / sample_count);
+    std::cout << name << " " << metric << ": " << median << " (min " << samples[0] << ", max " << samples[sample_count - 1] << ")" << std::endl;
+    this->results << name << "," << metric << "," << median << "," << samples[0] << "," << samples[sample_count - 1] << "," << deviation << std::endl;
   }
 
   // **************************************************************************
@@ -595,6 +5081,12 @@ namespace Codeloader {
   cAssembler::cAssembler(cSimulator* simulator) {
     this->simulator = simulator;
     this->pointer = 0;
+    this->line_count = 0;
+    this->linking = false;
+    // Vector instructions all take the same operands.
+    for (int vector = eINST_VADD; vector <= eINST_VOR_SCALAR; vector++) {
+      this->vectors[Get_Instruction_Name(vector)] = vector;
+    }
   }
 
   /**
@@ -603,6 +5095,7 @@ namespace Codeloader {
    * @throws An error if the source could not be loaded.
    */
   void cAssembler::Load_Source(std::string name) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
     std::ifstream source_file(name + ".asm");
     if (source_file) {
       int line_no = 0;
@@ -611,6 +5104,7 @@ namespace Codeloader {
         std::getline(source_file, line);
         if (source_file.good()) {
           line_no++;
+          this->line_count++;
           if (line.length() > 0) {
             if (line[0] == ':') { // Code line.
               std::string code_line = line.substr(1);
@@ -632,14 +5126,18 @@ namespace Codeloader {
     else {
       throw cError("Could not load " + name + ".");
     }
+    metrics.Add_Time(eMETRIC_TOKENIZE_TIME, start);
   }
 
   /**
-   * Compiles the source code.
+   * Compiles the source code. The program file holds the whole memory. When
+   * linking, the program is cut off after the last word that is not zero
+   * so it is only as big as the packed image.
    * @param name The name of the source file.
    * @throws An error if there is a syntax error.
    */
   void cAssembler::Compile_Source(std::string name) {
+    std::chrono::steady_clock::time_point parse_start = std::chrono::steady_clock::now();
     // Add default definitions.
     // Add interrupts.
     this->symtab["{screen}"] = eINTERRUPT_SCREEN;
@@ -665,9 +5163,11 @@ namespace Codeloader {
     this->symtab["(delete)"] = eSIGNAL_DELETE;
     this->symtab["(enter)"] = eSIGNAL_ENTER;
     this->symtab["(tab)"] = eSIGNAL_TAB;
+    this->Start_Block(""); // Anything before the first label.
     // Parse instructions.
     while (this->tokens.Count() > 0) {
       sToken instruction = this->Parse_Token();
+      int start = this->pointer;
       if (instruction.token == "define") {
         sToken name = this->Parse_Token();
         this->Parse_Keyword("as");
@@ -698,10 +5198,15 @@ namespace Codeloader {
       else if (instruction.token == "label") {
         sToken name = this->Parse_Token();
         this->symtab["[" + name.token + "]"] = this->pointer;
+        this->labels[name.token] = this->pointer;
+        this->Start_Block(name.token);
       }
       else if (instruction.token == "string") {
         this->Parse_String();
       }
+      else if (instruction.token == "embed") {
+        this->Parse_Embed();
+      }
       else if (instruction.token == "object") {
         sToken name = this->Parse_Token();
         sToken property = { "", 0, "" };
@@ -794,11 +5299,98 @@ namespace Codeloader {
         this->simulator->memory->Write_Number(this->pointer++, eINST_INTERRUPT);
         this->Parse_Value();
       }
+      else if (instruction.token == "spawn") {
+        this->simulator->memory->Write_Number(this->pointer++, eINST_SPAWN);
+        this->Parse_Address(); // Start
+        this->Parse_Address(); // Stack
+        this->Parse_Address(); // Thread number.
+      }
+      else if (instruction.token == "join") {
+        this->simulator->memory->Write_Number(this->pointer++, eINST_JOIN);
+        this->Parse_Address();
+      }
+      else if (instruction.token == "cas") {
+        this->simulator->memory->Write_Number(this->pointer++, eINST_CAS);
+        this->Parse_Address(); // Cell
+        this->Parse_Address(); // Expected
+        this->Parse_Address(); // New value.
+        this->Parse_Address(); // Old value.
+      }
+      else if (instruction.token == "fadd") {
+        this->simulator->memory->Write_Number(this->pointer++, eINST_FETCH_ADD);
+        this->Parse_Address(); // Cell
+        this->Parse_Address(); // Amount
+        this->Parse_Address(); // Old value.
+      }
+      else if (instruction.token == "fill") {
+        this->simulator->memory->Write_Number(this->pointer++, eINST_FILL);
+        this->Parse_Address(); // Start
+        this->Parse_Address(); // Value
+        this->Parse_Address(); // Count
+      }
+      else if (instruction.token == "move") {
+        this->simulator->memory->Write_Number(this->pointer++, eINST_MOVE);
+        this->Parse_Address(); // Source
+        this->Parse_Address(); // Destination
+        this->Parse_Address(); // Count
+      }
+      else if (instruction.token == "compare") {
+        this->simulator->memory->Write_Number(this->pointer++, eINST_COMPARE);
+        this->Parse_Address(); // Left
+        this->Parse_Address(); // Right
+        this->Parse_Address(); // Count
+        this->Parse_Address(); // Result
+      }
+      else if (instruction.token == "mod") {
+        this->simulator->memory->Write_Number(this->pointer++, eINST_MOD);
+        this->Parse_Address();
+        this->Parse_Address();
+        this->Parse_Address();
+      }
+      else if (instruction.token == "xor") {
+        this->simulator->memory->Write_Number(this->pointer++, eINST_XOR);
+        this->Parse_Address();
+        this->Parse_Address();
+        this->Parse_Address();
+      }
+      else if (instruction.token == "shl") {
+        this->simulator->memory->Write_Number(this->pointer++, eINST_SHL);
+        this->Parse_Address(); // Value
+        this->Parse_Address(); // Count
+        this->Parse_Address();
+      }
+      else if (instruction.token == "shr") {
+        this->simulator->memory->Write_Number(this->pointer++, eINST_SHR);
+        this->Parse_Address(); // Value
+        this->Parse_Address(); // Count
+        this->Parse_Address();
+      }
+      else if (instruction.token == "not") {
+        this->simulator->memory->Write_Number(this->pointer++, eINST_NOT);
+        this->Parse_Address();
+        this->Parse_Address();
+      }
+      else if (instruction.token == "mac") {
+        this->simulator->memory->Write_Number(this->pointer++, eINST_MAC);
+        this->Parse_Address();
+        this->Parse_Address();
+        this->Parse_Address(); // Total to add to.
+      }
+      else if (this->vectors.Does_Key_Exist(instruction.token)) {
+        this->simulator->memory->Write_Number(this->pointer++, this->vectors[instruction.token]);
+        this->Parse_Address(); // Left
+        this->Parse_Address(); // Right list or value.
+        this->Parse_Address(); // Destination
+        this->Parse_Address(); // Count
+      }
       else {
         throw cASM_Error(instruction, "Invalid instruction.");
       }
+      this->Mark_Block(instruction.token, start);
     }
+    metrics.Add_Time(eMETRIC_PARSE_TIME, parse_start);
     // Resolve placeholders.
+    std::chrono::steady_clock::time_point resolve_start = std::chrono::steady_clock::now();
     int placeholder_count = this->placeholders.Count();
     for (int placeholder_index = 0; placeholder_index < placeholder_count; placeholder_index++) {
       int location = this->placeholders.keys[placeholder_index];
@@ -812,8 +5404,519 @@ namespace Codeloader {
         throw cError("Could not find placeholder " + name + ".");
       }
     }
+    metrics.Add_Time(eMETRIC_RESOLVE_TIME, resolve_start);
+    if (this->linking) {
+      std::chrono::steady_clock::time_point link_start = std::chrono::steady_clock::now();
+      this->Link_Program(name);
+      metrics.Add_Time(eMETRIC_LINK_TIME, link_start);
+    }
     // Save the program to disk.
-    this->simulator->Save_Program(name);
+    std::chrono::steady_clock::time_point save_start = std::chrono::steady_clock::now();
+    this->simulator->Save_Program(name, this->linking); // Only linked programs are packed.
+    this->Save_Map(name);
+    metrics.Add_Time(eMETRIC_SAVE_TIME, save_start);
+  }
+
+  /**
+   * Saves the symbol map. Each line has the address of a label and its name
+   * sorted by address.
+   * @param name The name of the program.
+   * @throws An error if the map could not be saved.
+   */
+  void cAssembler::Save_Map(std::string name) {
+    std::vector<std::pair<int, std::string> > entries;
+    int label_count = this->labels.Count();
+    for (int label_index = 0; label_index < label_count; label_index++) {
+      entries.push_back(std::make_pair(this->labels.values[label_index], this->labels.keys[label_index]));
+    }
+    std::stable_sort(entries.begin(), entries.end());
+    std::ofstream map_file(name + ".map");
+    if (!map_file) {
+      throw cError("Could not save map " + name + ".");
+    }
+    for (int entry_index = 0; entry_index < label_count; entry_index++) {
+      if (entries[entry_index].first >= 0) { // Removed labels are -1.
+        map_file << entries[entry_index].first << "=" << entries[entry_index].second << std::endl;
+      }
+    }
+  }
+
+  /**
+   * Starts a new block at the current address. Every label starts a block.
+   * @param name The name of the label.
+   */
+  void cAssembler::Start_Block(std::string name) {
+    sBlock block;
+    block.name = name;
+    block.start = this->pointer;
+    block.size = 0;
+    block.falls_through = true; // An empty block runs into the next one.
+    block.chain = 0;
+    block.address = -1;
+    block.last = -1;
+    this->blocks.Push(block);
+  }
+
+  /**
+   * Notes whether the last thing put in the current block lets the code run
+   * into the next block. Data and jumps do not.
+   * @param instruction The instruction or directive that was compiled.
+   * @param start The address the instruction was compiled to.
+   */
+  void cAssembler::Mark_Block(std::string instruction, int start) {
+    if ((instruction == "define") || (instruction == "label") || (instruction == "object") || (instruction == "map")) {
+      return; // Nothing was put in memory.
+    }
+    bool data = (instruction == "number") || (instruction == "list") || (instruction == "objects") || (instruction == "string") || (instruction == "embed");
+    bool jumps = (instruction == "jump") || (instruction == "return") || (instruction == "halt");
+    this->blocks[this->blocks.Count() - 1].falls_through = !(data || jumps);
+    this->blocks[this->blocks.Count() - 1].last = data ? -1 : start;
+  }
+
+  /**
+   * Finds the block that holds an address.
+   * @param address The address.
+   * @return The index of the block or -1 if no block holds the address.
+   */
+  int cAssembler::Find_Block(int address) {
+    int low = 0;
+    int high = this->blocks.Count() - 1;
+    int found = -1;
+    while (low <= high) {
+      int middle = (low + high) / 2;
+      if (this->blocks[middle].start <= address) {
+        found = middle;
+        low = middle + 1;
+      }
+      else {
+        high = middle - 1;
+      }
+    }
+    if ((found != -1) && (address >= this->blocks[found].start + this->blocks[found].size)) {
+      return -1; // Past the end of the program.
+    }
+    return found;
+  }
+
+  /**
+   * Removes blocks that cannot be reached and packs the rest together. Blocks
+   * that run into each other are moved as one chain. The chains holding the
+   * entry point, the interrupt vector and the stack stay where the config
+   * expects them. The others are laid out in the order they are reached so
+   * code sits next to the data it uses, filling holes before going past
+   * the end. If <name>.profile is there the hot paths are laid out first and
+   * made to fall through. Only label references are moved so literal
+   * addresses in the source must not point at code or data that moves.
+   * @param name The name of the program. A report is written to
+   * <name>.link.txt.
+   * @throws An error if the program does not fit in memory.
+   */
+  void cAssembler::Link_Program(std::string name) {
+    cMemory* memory = this->simulator->memory;
+    int block_count = this->blocks.Count();
+    for (int block_index = 0; block_index < block_count; block_index++) {
+      int end = (block_index + 1 < block_count) ? this->blocks[block_index + 1].start : this->pointer;
+      this->blocks[block_index].size = end - this->blocks[block_index].start;
+    }
+    // Blocks that run into the next one are chained to it.
+    this->chains.clear();
+    for (int block_index = 0; block_index < block_count; block_index++) {
+      if ((block_index == 0) || !this->blocks[block_index - 1].falls_through) {
+        this->chains.push_back(std::vector<int>());
+      }
+      this->chains.back().push_back(block_index);
+      this->blocks[block_index].chain = (int)this->chains.size() - 1;
+    }
+    int chain_count = (int)this->chains.size();
+    // Find every label reference.
+    std::map<std::string, int> block_names;
+    for (int block_index = 1; block_index < block_count; block_index++) {
+      block_names["[" + this->blocks[block_index].name + "]"] = block_index;
+    }
+    this->references.clear();
+    this->reference_at.clear();
+    std::vector<std::pair<int, int> > found; // Location and block.
+    int placeholder_count = this->placeholders.Count();
+    for (int placeholder_index = 0; placeholder_index < placeholder_count; placeholder_index++) {
+      std::map<std::string, int>::iterator target = block_names.find(this->placeholders.values[placeholder_index]);
+      if (target != block_names.end()) {
+        found.push_back(std::make_pair(this->placeholders.keys[placeholder_index], target->second));
+      }
+    }
+    std::sort(found.begin(), found.end());
+    std::vector<std::vector<int> > edges(chain_count);
+    int found_count = (int)found.size();
+    for (int found_index = 0; found_index < found_count; found_index++) {
+      sReference reference;
+      reference.location = found[found_index].first;
+      reference.block = this->Find_Block(reference.location);
+      reference.target = found[found_index].second;
+      this->reference_at[reference.location] = (int)this->references.size();
+      this->references.push_back(reference);
+      edges[this->blocks[reference.block].chain].push_back(this->blocks[reference.target].chain);
+    }
+    // Walk from the roots. The entry point goes first.
+    this->pinned.assign(chain_count, false);
+    std::vector<int> roots;
+    int root_addresses[3] = { this->simulator->pc, this->simulator->interrupt_pointer, this->simulator->sp };
+    for (int root_index = 0; root_index < 3; root_index++) {
+      int block = this->Find_Block(root_addresses[root_index]);
+      if (block != -1) {
+        this->pinned[this->blocks[block].chain] = true;
+        roots.push_back(this->blocks[block].chain);
+      }
+    }
+    std::vector<bool> live(chain_count, false);
+    std::vector<int> order;
+    int root_count = (int)roots.size();
+    for (int root_index = 0; root_index < root_count; root_index++) {
+      std::vector<int> stack(1, roots[root_index]);
+      while (!stack.empty()) {
+        int chain = stack.back();
+        stack.pop_back();
+        if (!live[chain]) {
+          live[chain] = true;
+          order.push_back(chain);
+          for (int edge_index = (int)edges[chain].size() - 1; edge_index >= 0; edge_index--) {
+            stack.push_back(edges[chain][edge_index]);
+          }
+        }
+      }
+    }
+    std::vector<int> follows(chain_count, -1);
+    std::vector<std::string> fall_throughs;
+    this->Apply_Profile(name, live, order, follows, fall_throughs);
+    chain_count = (int)this->chains.size(); // Chains split by the profile.
+    // Pinned chains stay put and leave holes between them.
+    std::vector<int> chain_address(chain_count, -1);
+    std::vector<std::pair<int, int> > holes;
+    int top = 0;
+    for (int chain = 0; chain < chain_count; chain++) {
+      if (this->pinned[chain] && (this->Get_Chain_Size(chain) > 0)) {
+        chain_address[chain] = this->blocks[this->chains[chain][0]].start;
+        if (chain_address[chain] > top) {
+          holes.push_back(std::make_pair(top, chain_address[chain]));
+        }
+        top = chain_address[chain] + this->Get_Chain_Size(chain);
+      }
+    }
+    holes.push_back(std::make_pair(top, memory->count));
+    int hole_count = (int)holes.size();
+    int order_count = (int)order.size();
+    for (int order_index = 0; order_index < order_count; order_index++) {
+      int chain = order[order_index];
+      int size = this->Get_Chain_Size(chain);
+      if ((chain_address[chain] == -1) && (size > 0)) {
+        // Hot chains go right after the chain they are reached from if
+        // there is room.
+        int after = -1;
+        if ((follows[chain] != -1) && (chain_address[follows[chain]] != -1)) {
+          after = chain_address[follows[chain]] + this->Get_Chain_Size(follows[chain]);
+        }
+        for (int hole_index = 0; hole_index < hole_count; hole_index++) {
+          if ((holes[hole_index].first == after) && (holes[hole_index].second - holes[hole_index].first >= size)) {
+            chain_address[chain] = holes[hole_index].first;
+            holes[hole_index].first += size;
+            break;
+          }
+        }
+        for (int hole_index = 0; (hole_index < hole_count) && (chain_address[chain] == -1); hole_index++) {
+          if (holes[hole_index].second - holes[hole_index].first >= size) {
+            chain_address[chain] = holes[hole_index].first;
+            holes[hole_index].first += size;
+          }
+        }
+        if (chain_address[chain] == -1) {
+          throw cError("Program does not fit in memory after linking.");
+        }
+      }
+    }
+    // Empty labels mark the end of the program so they go last.
+    int end = 0;
+    for (int chain = 0; chain < chain_count; chain++) {
+      if (chain_address[chain] != -1) {
+        end = std::max(end, chain_address[chain] + this->Get_Chain_Size(chain));
+      }
+    }
+    for (int chain = 0; chain < chain_count; chain++) {
+      if (live[chain] && (chain_address[chain] == -1)) {
+        chain_address[chain] = end;
+      }
+    }
+    // Copy the live blocks to their new places.
+    std::vector<int> image(end, 0);
+    for (int chain = 0; chain < chain_count; chain++) {
+      int address = chain_address[chain];
+      int chain_size = (int)this->chains[chain].size();
+      for (int member_index = 0; (member_index < chain_size) && live[chain]; member_index++) {
+        sBlock& block = this->blocks[this->chains[chain][member_index]];
+        block.address = address;
+        for (int word_index = 0; word_index < block.size; word_index++) {
+          image[address++] = memory->Read_Number(block.start + word_index);
+        }
+      }
+    }
+    for (int block_index = 1; block_index < block_count; block_index++) {
+      this->labels[this->blocks[block_index].name] = this->blocks[block_index].address;
+    }
+    int reference_count = (int)this->references.size();
+    for (int reference_index = 0; reference_index < reference_count; reference_index++) {
+      sReference& reference = this->references[reference_index];
+      sBlock& from = this->blocks[reference.block];
+      if ((reference.target != -1) && (from.address != -1)) {
+        image[from.address + (reference.location - from.start)] = this->blocks[reference.target].address;
+      }
+    }
+    memory->Clear();
+    for (int address = 0; address < end; address++) {
+      memory->Write_Number(address, image[address]);
+    }
+    // Report what happened.
+    std::ofstream report(name + ".link.txt");
+    if (!report) {
+      throw cError("Could not save link report " + name + ".");
+    }
+    int removed_words = 0;
+    report << "Removed:" << std::endl;
+    for (int block_index = 0; block_index < block_count; block_index++) {
+      sBlock& block = this->blocks[block_index];
+      if ((block.address == -1) && ((block_index > 0) || (block.size > 0))) {
+        report << "  " << ((block_index > 0) ? block.name : "(start)") << " at " << block.start << ", " << block.size << " words" << std::endl;
+        removed_words += block.size;
+      }
+    }
+    report << "Moved:" << std::endl;
+    for (int block_index = 0; block_index < block_count; block_index++) {
+      sBlock& block = this->blocks[block_index];
+      if ((block.address != -1) && (block.address != block.start)) {
+        report << "  " << block.name << " from " << block.start << " to " << block.address << std::endl;
+      }
+    }
+    if (fall_throughs.size() > 0) {
+      report << "Fall Through:" << std::endl;
+      for (int fall_index = 0; fall_index < (int)fall_throughs.size(); fall_index++) {
+        report << "  " << fall_throughs[fall_index] << std::endl;
+      }
+    }
+    report << "Removed " << removed_words << " words. The program went from " << this->pointer << " to " << end << " words." << std::endl;
+    std::cout << "Linked " << name << " from " << this->pointer << " to " << end << " words." << std::endl;
+  }
+
+  /**
+   * Gets the number of words in a chain.
+   * @param chain The chain number.
+   * @return The size of the chain.
+   */
+  int cAssembler::Get_Chain_Size(int chain) {
+    int size = 0;
+    int member_count = (int)this->chains[chain].size();
+    for (int member_index = 0; member_index < member_count; member_index++) {
+      size += this->blocks[this->chains[chain][member_index]].size;
+    }
+    return size;
+  }
+
+  /**
+   * Uses a profile from a run to lay out the hot paths. The hottest jumps
+   * are turned into fall throughs where the jump is the last instruction of
+   * its block. Chains joined by other hot jumps are placed one after the
+   * other, and the hottest chains are laid out first.
+   * @param name The name of the program. The profile is <name>.profile.
+   * @param live Which chains are reachable. Chains that are split off are
+   * added.
+   * @param order The order the chains are laid out in.
+   * @param follows The chain that each chain should be placed after.
+   * @param fall_throughs Descriptions of the jumps that were made to fall
+   * through.
+   * @return True if there was a profile, false otherwise.
+   */
+  bool cAssembler::Apply_Profile(std::string name, std::vector<bool>& live, std::vector<int>& order, std::vector<int>& follows, std::vector<std::string>& fall_throughs) {
+    std::ifstream profile(name + ".profile");
+    if (!profile) {
+      return false;
+    }
+    std::map<std::string, int> block_names;
+    int block_count = this->blocks.Count();
+    for (int block_index = 1; block_index < block_count; block_index++) {
+      block_names[this->blocks[block_index].name] = block_index;
+    }
+    std::vector<long long> heat(block_count, 0);
+    std::vector<std::pair<long long, std::pair<int, int> > > hot_edges;
+    std::string kind;
+    while (profile >> kind) {
+      std::string from;
+      std::string to;
+      long long count = 0;
+      if (kind == "label") {
+        profile >> from >> count;
+        if (block_names.count(from) > 0) {
+          heat[block_names[from]] = count;
+        }
+      }
+      else if (kind == "edge") {
+        profile >> from >> to >> count;
+        if ((block_names.count(from) > 0) && (block_names.count(to) > 0)) {
+          hot_edges.push_back(std::make_pair(count, std::make_pair(block_names[from], block_names[to])));
+        }
+      }
+      else {
+        throw cError("Invalid profile entry " + kind + " in " + name + ".profile.");
+      }
+    }
+    std::stable_sort(hot_edges.rbegin(), hot_edges.rend());
+    int edge_count = (int)hot_edges.size();
+    for (int edge_index = 0; edge_index < edge_count; edge_index++) {
+      int from = hot_edges[edge_index].second.first;
+      int to = hot_edges[edge_index].second.second;
+      if (live[this->blocks[from].chain] && this->Fall_Through(from, to, live, order)) {
+        fall_throughs.push_back(this->blocks[from].name + " -> " + this->blocks[to].name);
+      }
+    }
+    // Place chains after the chain their hottest jump comes from.
+    int chain_count = (int)this->chains.size();
+    follows.assign(chain_count, -1);
+    std::vector<int> followed_by(chain_count, -1);
+    for (int edge_index = 0; edge_index < edge_count; edge_index++) {
+      int from = this->blocks[hot_edges[edge_index].second.first].chain;
+      int to = this->blocks[hot_edges[edge_index].second.second].chain;
+      if ((from != to) && live[from] && live[to] && !this->pinned[to] && (followed_by[from] == -1) && (follows[to] == -1)) {
+        int head = from;
+        while ((follows[head] != -1) && (head != to)) {
+          head = follows[head];
+        }
+        if (head != to) { // Would make a loop.
+          followed_by[from] = to;
+          follows[to] = from;
+        }
+      }
+    }
+    // Lay out the hottest groups first and the rest in the order reached.
+    std::vector<long long> chain_heat(chain_count, 0);
+    for (int block_index = 0; block_index < block_count; block_index++) {
+      int chain = this->blocks[block_index].chain;
+      chain_heat[chain] = std::max(chain_heat[chain], heat[block_index]);
+    }
+    std::vector<std::pair<long long, int> > groups;
+    int order_count = (int)order.size();
+    for (int order_index = 0; order_index < order_count; order_index++) {
+      int chain = order[order_index];
+      if (follows[chain] == -1) {
+        long long group_heat = 0;
+        for (int member = chain; member != -1; member = followed_by[member]) {
+          group_heat = std::max(group_heat, chain_heat[member]);
+        }
+        groups.push_back(std::make_pair(-group_heat, order_index));
+      }
+    }
+    std::stable_sort(groups.begin(), groups.end());
+    std::vector<int> layout;
+    int group_count = (int)groups.size();
+    for (int group_index = 0; group_index < group_count; group_index++) {
+      for (int member = order[groups[group_index].second]; member != -1; member = followed_by[member]) {
+        layout.push_back(member);
+      }
+    }
+    order = layout;
+    return true;
+  }
+
+  /**
+   * Makes a jump from one block to another fall through by moving the
+   * target's chain right after the block. A jump at the end of the block is
+   * dropped. A test at the end of the block has the target replaced with no
+   * jump, and if the block ran into the next one the test jumps there
+   * instead.
+   * @param from The block with the jump.
+   * @param to The block that is jumped to.
+   * @param live Which chains are reachable. Chains that are split off are
+   * added.
+   * @param order The order the chains are laid out in.
+   * @return True if the jump now falls through, false otherwise.
+   */
+  bool cAssembler::Fall_Through(int from, int to, std::vector<bool>& live, std::vector<int>& order) {
+    cMemory* memory = this->simulator->memory;
+    sBlock& block = this->blocks[from];
+    int from_chain = block.chain;
+    int to_chain = this->blocks[to].chain;
+    if ((block.last == -1) || (from_chain == to_chain) || (this->chains[to_chain][0] != to) || this->pinned[to_chain]) {
+      return false;
+    }
+    int instruction = memory->Read_Number(block.last);
+    int end = block.start + block.size;
+    bool tail = (this->chains[from_chain].back() == from);
+    int target = -1; // Where the jump to the block is.
+    int other = -1; // The other way out of a test.
+    if ((instruction == eINST_JUMP) && (block.last + 2 == end) && tail) {
+      target = block.last + 1;
+    }
+    else if ((instruction == eINST_TEST) && (block.last + 8 == end)) {
+      target = block.last + 6;
+      other = block.last + 7;
+      if ((this->reference_at.count(target) == 0) || (this->references[this->reference_at[target]].target != to)) {
+        std::swap(target, other);
+      }
+      if (tail && (this->reference_at.count(other) == 0)) {
+        return false; // Both ways are already taken care of.
+      }
+      if (!tail && ((memory->Read_Number(other) != TAKE_NO_JUMP) || this->pinned[from_chain])) {
+        return false;
+      }
+    }
+    if ((target == -1) || (this->reference_at.count(target) == 0) || (this->references[this->reference_at[target]].target != to)) {
+      return false;
+    }
+    // A pinned chain can only grow into the space before the next one.
+    int growth = this->Get_Chain_Size(to_chain) - ((instruction == eINST_JUMP) ? 2 : 0);
+    if (this->pinned[from_chain]) {
+      int start = this->blocks[this->chains[from_chain][0]].start;
+      int limit = this->simulator->memory->count;
+      int chain_count = (int)this->chains.size();
+      for (int chain = 0; chain < chain_count; chain++) {
+        int chain_start = this->chains[chain].empty() ? -1 : this->blocks[this->chains[chain][0]].start;
+        if (this->pinned[chain] && (chain_start > start)) {
+          limit = std::min(limit, chain_start);
+        }
+      }
+      if (start + this->Get_Chain_Size(from_chain) + growth > limit) {
+        return false;
+      }
+    }
+    this->references[this->reference_at[target]].target = -1;
+    if (instruction == eINST_JUMP) {
+      block.size -= 2;
+    }
+    else {
+      memory->Write_Number(target, TAKE_NO_JUMP);
+      if (!tail) {
+        // Split off the rest of the chain and jump to it.
+        std::vector<int>& members = this->chains[from_chain];
+        int split = (int)(std::find(members.begin(), members.end(), from) - members.begin()) + 1;
+        std::vector<int> rest(members.begin() + split, members.end());
+        members.resize(split);
+        int rest_chain = (int)this->chains.size();
+        this->chains.push_back(rest);
+        this->pinned.push_back(false);
+        live.push_back(true);
+        order.push_back(rest_chain);
+        for (int member_index = 0; member_index < (int)rest.size(); member_index++) {
+          this->blocks[rest[member_index]].chain = rest_chain;
+        }
+        sReference reference;
+        reference.location = other;
+        reference.block = from;
+        reference.target = rest[0];
+        this->reference_at[other] = (int)this->references.size();
+        this->references.push_back(reference);
+      }
+    }
+    // Move the target's chain onto the end of this one.
+    std::vector<int>& moved = this->chains[to_chain];
+    for (int member_index = 0; member_index < (int)moved.size(); member_index++) {
+      this->blocks[moved[member_index]].chain = from_chain;
+      this->chains[from_chain].push_back(moved[member_index]);
+    }
+    moved.clear();
+    return true;
   }
 
   /**
@@ -882,6 +5985,117 @@ namespace Codeloader {
     }
   }
 
+  /**
+   * Parses an embed directive and streams the file into memory. The file is
+   * read in chunks and never tokenized.
+   *
+   *   :embed <file> [bytes | words | csv] [sized]
+   *
+   * Bytes puts each byte in a word, words reads 32-bit little endian words,
+   * and csv reads numbers split by commas, spaces, or lines. Sized writes
+   * the count first like a string does.
+   * @throws An error if the file could not be read or does not fit.
+   */
+  void cAssembler::Parse_Embed() {
+    sToken file = this->Parse_Token();
+    std::string format = "bytes";
+    bool sized = false;
+    // Options are only taken from the same line.
+    while ((this->tokens.Count() > 0) && (this->tokens[0].line_no == file.line_no) && (this->tokens[0].source == file.source)) {
+      sToken option = this->Parse_Token();
+      if ((option.token == "bytes") || (option.token == "words") || (option.token == "csv")) {
+        format = option.token;
+      }
+      else if (option.token == "sized") {
+        sized = true;
+      }
+      else {
+        throw cASM_Error(option, "Invalid embed option.");
+      }
+    }
+    std::ifstream embed_file(file.token, std::ios::binary);
+    if (!embed_file) {
+      throw cASM_Error(file, "Could not load " + file.token + ".");
+    }
+    cMemory* memory = this->simulator->memory;
+    int size_address = this->pointer;
+    if (sized) {
+      memory->Write_Number(this->pointer++, 0); // Filled in at the end.
+    }
+    std::vector<char> buffer(EMBED_BUFFER);
+    int start = this->pointer;
+    if (format == "csv") {
+      long long number = 0;
+      bool negative = false;
+      bool in_number = false;
+      while (embed_file) {
+        embed_file.read(&buffer[0], EMBED_BUFFER);
+        int byte_count = (int)embed_file.gcount();
+        for (int byte_index = 0; byte_index < byte_count; byte_index++) {
+          char letter = buffer[byte_index];
+          if ((letter >= '0') && (letter <= '9')) {
+            number = (number * 10) + (letter - '0');
+            in_number = true;
+          }
+          else if ((letter == '-') && !in_number && !negative) {
+            negative = true;
+          }
+          else if ((letter == ',') || (letter == ' ') || (letter == '\t') || (letter == '\r') || (letter == '\n')) {
+            if (in_number) {
+              memory->Write_Number(this->pointer++, (int)(negative ? -number : number));
+            }
+            else if (negative) {
+              throw cASM_Error(file, "Invalid number in " + file.token + ".");
+            }
+            number = 0;
+            negative = false;
+            in_number = false;
+          }
+          else {
+            throw cASM_Error(file, "Invalid character in " + file.token + ".");
+          }
+        }
+      }
+      if (in_number) { // The file may not end with a line break.
+        memory->Write_Number(this->pointer++, (int)(negative ? -number : number));
+      }
+    }
+    else {
+      embed_file.seekg(0, std::ios::end);
+      long long file_size = (long long)embed_file.tellg();
+      embed_file.seekg(0, std::ios::beg);
+      int unit = (format == "words") ? 4 : 1;
+      if ((file_size % unit) != 0) {
+        throw cASM_Error(file, file.token + " is not made of whole words.");
+      }
+      if (file_size / unit > memory->count - this->pointer) {
+        throw cASM_Error(file, file.token + " does not fit in memory.");
+      }
+      int count = (int)(file_size / unit);
+      memory->Touch_Range(this->pointer, count);
+      int* destination = memory->memory + this->pointer;
+      while (embed_file) {
+        embed_file.read(&buffer[0], EMBED_BUFFER); // A multiple of the word size.
+        int byte_count = (int)embed_file.gcount();
+        if (unit == 1) {
+          for (int byte_index = 0; byte_index < byte_count; byte_index++) {
+            *destination++ = (unsigned char)buffer[byte_index];
+          }
+        }
+        else {
+          for (int byte_index = 0; byte_index < byte_count; byte_index += 4) {
+            unsigned char* bytes = (unsigned char*)&buffer[byte_index];
+            *destination++ = (int)((unsigned int)bytes[0] | ((unsigned int)bytes[1] << 8) | ((unsigned int)bytes[2] << 16) | ((unsigned int)bytes[3] << 24));
+          }
+        }
+      }
+      this->pointer += count;
+    }
+    if (sized) {
+      memory->Write_Number(size_address, this->pointer - start);
+    }
+  }
+
   /**
    * Parses an address.
    * @throws An error if the address is invalid.
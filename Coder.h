@@ -3,8 +3,82 @@
 // Programmed by Francois Lamini
 // ============================================================================
 
+#ifdef _WIN32
+  #include <winsock2.h> // Must come before windows.h.
+  #include <afunix.h>
+  typedef SOCKET tSocket;
+  #define close_socket closesocket
+  #define SHUTDOWN_BOTH SD_BOTH
+#else
+  #include <sys/socket.h>
+  #include <sys/un.h>
+  #include <unistd.h>
+  typedef int tSocket;
+  #define INVALID_SOCKET -1
+  #define close_socket close
+  #define SHUTDOWN_BOTH SHUT_RDWR
+#endif
 #include "..\Code_Helper\Codeloader.hpp"
 #include "..\Code_Helper\Allegro.hpp"
+#include <thread>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <map>
+#include <vector>
+#include <cmath>
+#include <cstdlib>
+#include <iterator>
+#include <random>
+#include <new>
+
+#if (defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))) || (defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86)))
+  #define VECTOR_X86
+  #include <immintrin.h>
+  #ifdef _MSC_VER
+    #include <intrin.h>
+    #define VECTOR_TARGET(name)
+  #else
+    #define VECTOR_TARGET(name) __attribute__((target(name)))
+  #endif
+#endif
+
+#define SPIN_TARGET_MAX 4
+#define HOST_SLICE 10000
+#define THREAD_WAIT 1
+#define MEMORY_PAGE_SHIFT 8
+#define MEMORY_PAGE_SIZE (1 << MEMORY_PAGE_SHIFT)
+#define STATE_VERSION 2
+#define STATE_MEMORY_MAX (1 << 26)
+#define TRACE_INTERVAL 10000000
+#define TRACE_BUFFER 65536
+#define BENCH_RUNS 5
+#define BENCH_LIMIT 1000000000LL
+#define BENCH_GENERATED_LINES 4000
+#define SERVER_RUN_LIMIT 100000000LL
+#define DEBUG_RUN_LIMIT 100000000LL
+#define EMBED_BUFFER 65536
+#define CONFORM_POINTERS 8
+#define CONFORM_POINTER_COUNT 16
+#define CONFORM_DATA 512
+#define CONFORM_DATA_SIZE 256
+#define CONFORM_STACK 768
+#define CONFORM_THREAD_STACK 896
+#define CONFORM_CODE 1024
+#define CONFORM_MEMORY 4096
+#define CONFORM_LENGTH 60
+#define CONFORM_ROUTINES 3
+#define CONFORM_ROUTINE_LENGTH 8
+#define CONFORM_BATCH 8
+#define CONFORM_STEP_LIMIT 100000
+#define CONFORM_BUDGET 300
+#define RUN_CLOCK_CHECK 256
+#define METRICS_FLUSH_INTERVAL 1000
 
 namespace Codeloader {
 
@@ -23,7 +97,37 @@ namespace Codeloader {
     eINST_AND,
     eINST_OR,
     eINST_HALT,
-    eINST_INTERRUPT
+    eINST_INTERRUPT,
+    eINST_SPAWN,
+    eINST_JOIN,
+    eINST_CAS,
+    eINST_FETCH_ADD,
+    eINST_FILL,
+    eINST_MOVE,
+    eINST_COMPARE,
+    eINST_VADD,
+    eINST_VSUB,
+    eINST_VMUL,
+    eINST_VAND,
+    eINST_VOR,
+    eINST_VADD_SCALAR,
+    eINST_VSUB_SCALAR,
+    eINST_VMUL_SCALAR,
+    eINST_VAND_SCALAR,
+    eINST_VOR_SCALAR,
+    eINST_MOD,
+    eINST_XOR,
+    eINST_SHL,
+    eINST_SHR,
+    eINST_NOT,
+    eINST_MAC,
+    eINST_TRAP
+  };
+
+  enum eVector_Level {
+    eVECTOR_SCALAR,
+    eVECTOR_SSE4,
+    eVECTOR_AVX2
   };
 
   enum eAddress {
@@ -47,6 +151,92 @@ namespace Codeloader {
     eINTERRUPT_TIMEOUT
   };
 
+  enum eMetric {
+    eMETRIC_CONFIG_TIME,
+    eMETRIC_TOKENIZE_TIME,
+    eMETRIC_PARSE_TIME,
+    eMETRIC_RESOLVE_TIME,
+    eMETRIC_LINK_TIME,
+    eMETRIC_SAVE_TIME,
+    eMETRIC_LOAD_TIME,
+    eMETRIC_INSTRUCTIONS,
+    eMETRIC_RUNS,
+    eMETRIC_RUN_OVERSHOOT,
+    eMETRIC_RUN_OVERSHOOT_MAX,
+    eMETRIC_INTERRUPT_SCREEN,
+    eMETRIC_INTERRUPT_INPUT,
+    eMETRIC_INTERRUPT_TIMEOUT,
+    eMETRIC_DRAW_TIME,
+    eMETRIC_CELLS_DRAWN,
+    eMETRIC_COUNT
+  };
+
+  struct sRegisters {
+    int pc;
+    int sp;
+    int status;
+    int interrupt_pointer;
+  };
+
+  struct sCall_Node {
+    int parent;
+    int target;
+    long long count;
+  };
+
+  struct sBlock {
+    std::string name;
+    int start;
+    int size;
+    bool falls_through;
+    int chain;
+    int address;
+    int last;
+  };
+
+  struct sReference {
+    int location;
+    int block;
+    int target;
+  };
+
+  struct sGenerated {
+    int instruction;
+    std::vector<int> words;
+    int target;
+    int other;
+  };
+
+  struct sConform_Program {
+    std::vector<std::vector<sGenerated> > routines;
+    std::vector<int> data;
+    std::vector<int> pointers;
+  };
+
+  struct sModel_Thread {
+    int pc;
+    int sp;
+    int status;
+    bool failed;
+  };
+
+  struct sTrace_Event {
+    char type;
+    long long instruction;
+    int value;
+    size_t offset;
+  };
+
+  std::string Get_Instruction_Name(int instruction);
+  int Find_Vector_Level();
+  int Get_Vector_Level();
+  void Set_Vector_Level(int level);
+  int Modulo(int left, int right);
+  int Shift_Left(int value, int count);
+  int Shift_Right(int value, int count);
+  int Run_Vector_Kernel(int operation, int* destination, int* left, int* right, int scalar, int count);
+  std::string Get_Metric_Name(int metric);
+
   class cASM_Error: public cError {
 
     public:
@@ -57,20 +247,158 @@ namespace Codeloader {
 
   };
 
+  class cMetrics {
+
+    public:
+      std::atomic<long long> counters[eMETRIC_COUNT];
+      std::string file;
+      std::thread* flusher;
+      std::mutex lock;
+      std::condition_variable wake;
+      bool stopping;
+
+      cMetrics();
+      ~cMetrics();
+      void Add(int metric, long long amount);
+      void Add_Time(int metric, std::chrono::steady_clock::time_point start);
+      void Raise(int metric, long long value);
+      void Start_Flushing(std::string file, int interval);
+      void Flush_Loop(int interval);
+      void Stop_Flushing();
+      void Flush();
+      void Print_Summary();
+
+  };
+
+  extern cMetrics metrics;
+
   class cMemory {
 
     public:
       int* memory;
       int count;
+      std::atomic<int> writes;
+      std::mutex lock;
+      int page_count;
+      unsigned char* page_traps;
+      int** saved_pages;
+      bool snapshot;
+      unsigned char* dirty_pages;
+      int* dirty_list;
+      int dirty_count;
+      bool tracking;
+      int* watch_counts;
+      bool* watch_flag;
+      std::mutex page_lock;
+      std::mutex sleep_lock;
+      std::condition_variable wake;
 
       cMemory(int size);
       ~cMemory();
       int Read_Number(int address);
       void Write_Number(int address, int value);
+      int Compare_And_Swap(int address, int expected, int value);
+      int Fetch_And_Add(int address, int amount);
+      void Check_Range(int address, int count);
+      void Touch_Range(int address, int count);
+      void Fill(int address, int value, int count);
+      void Move(int source, int destination, int count);
+      int Compare(int left, int right, int count);
+      void Vector(int operation, int left, int right, int destination, int count, bool scalar);
       void Clear();
+      void Trap_Write(int page);
+      void Update_Trap(int page);
+      bool Is_Page_Clear(int page);
+      void Take_Snapshot();
+      void Restore_Snapshot();
+      void Drop_Snapshot();
+      void Track_Dirty();
+      void Clear_Dirty();
+      void Mark_Dirty(int page);
+      void Watch(int address);
+      void Unwatch(int address);
+      bool Is_Trapped(int page);
+      void Set_Trap(int page, bool trapped);
+      void Wait_For_Write(int seen, std::atomic<bool>& stopping);
+      void Wake_Sleepers();
 
   };
   
+  class cSymbols {
+
+    public:
+      cArray<int> addresses;
+      cArray<std::string> names;
+
+      void Load(std::string name);
+      int Find_Label(int address);
+      std::string Find_Name(int address);
+      int Find_Address(std::string name);
+
+  };
+
+#ifdef CODER_PROFILE
+  class cProfiler {
+
+    public:
+      std::map<int, long long> instruction_counts;
+      long long* pc_counts;
+      int pc_count;
+      std::map<std::pair<int, int>, long long> edges;
+      std::map<int, long long> call_counts;
+      std::vector<sCall_Node> calls;
+      std::map<std::pair<int, int>, int> call_index;
+      int call;
+
+      cProfiler(int memory_size, int entry);
+      ~cProfiler();
+      void Count(int pc, int instruction);
+      void Jump(int from, int to);
+      void Call(int from, int to);
+      void Return(int from, int to);
+      void Save_Report(std::string name);
+      std::string Get_Stack(cSymbols& symbols, int node);
+
+  };
+#endif
+
+  class cSimulator;
+
+  class cTrace {
+
+    public:
+      std::string name;
+      bool recording;
+      std::ofstream file;
+      std::vector<unsigned char> data;
+      long long last_instruction;
+      long long interval;
+      long long next_checkpoint;
+      std::vector<sTrace_Event> events;
+      int event_index;
+      size_t cursor;
+
+      cTrace(std::string name, bool recording, long long interval);
+      ~cTrace();
+      void Record_Event(char type, long long instruction, int value);
+      void Record_Key(long long instruction, int code);
+      void Record_Timer(long long instruction, int delay);
+      void Record_Checkpoint(cSimulator* simulator);
+      void Record_End(long long instruction, bool failed);
+      void Flush();
+      int Replay_Event(char type, long long instruction);
+      int Replay_Key(long long instruction);
+      void Replay_Timer(long long instruction, int delay);
+      long long Get_End();
+      bool Has_Failed();
+      void Seek(cSimulator* simulator, long long instruction);
+      void Write_Number(unsigned long long number);
+      void Write_Signed(long long number);
+      unsigned long long Read_Number();
+      long long Read_Signed();
+
+  };
+
   class cSimulator {
 
     public:
@@ -83,23 +411,235 @@ namespace Codeloader {
       int height;
       int letter_w;
       int letter_h;
+      bool spinning;
+      int spin_writes;
+      int spin_sp;
+      int spin_count;
+      bool spin_input;
+      int spin_targets[SPIN_TARGET_MAX];
+      bool yielding;
+      bool debugging;
+      bool breaking;
+      long long instructions;
       cIO_Control* io;
+      cSimulator* parent;
+      cArray<cSimulator*> threads;
+      cArray<std::thread*> runners;
+      std::atomic<bool> stopping;
+      std::string error;
+      sRegisters snapshot;
+      sRegisters start;
+      cTrace* trace;
+#ifdef CODER_PROFILE
+      cProfiler* profiler;
+#endif
+      std::string name;
+      int checkpoint_interval;
+      int compact_interval;
+      int delta_count;
+      int generation;
+      long long next_checkpoint;
 
       cSimulator(cIO_Control* io, std::string config);
+      cSimulator(cSimulator* parent, int pc, int sp);
       ~cSimulator();
       void Load_Program(std::string name);
-      void Save_Program(std::string name);
+      void Save_Program(std::string name, bool trim);
+      void Save_State(std::string name);
+      void Load_State(std::string name);
+      void Write_State(std::string name, bool delta);
+      bool Read_State(std::string name, bool delta);
+      int Read_Generation(std::string name);
+      void Save_Checkpoint();
+      void Load_Checkpoint(std::string name);
+      void Take_Snapshot();
+      void Restore_Snapshot();
+      sRegisters Get_Registers();
+      void Set_Registers(sRegisters registers);
+      bool Has_Threads();
+      void Check_Threads();
+      void Stop_Threads();
+      void Check_Trace();
+      void Reset();
+      std::string Get_Screen_Text();
       void Step();
       void Run(int timeout);
+      int Run_Slice(int budget);
       int Fetch_Number();
       void Put_Number(int number);
       int Fetch_From_Address();
+      int Peek_From_Address();
       void Write_To_Address(int value);
       bool Eval_Test();
       void Push(int value);
       int Pop();
       void Process_Interrupt(int interrupt);
       void Draw_Screen(cMemory* memory, int address);
+      void Vector(int operation, bool scalar);
+      void Watch_Spin(int address);
+      int Spawn_Thread(int address, int stack);
+      void Join_Thread(int thread);
+      void Run_Thread();
+
+  };
+
+  class cHeadless_IO: public cIO_Control {
+
+    public:
+      int frames;
+      int reads;
+      std::chrono::steady_clock::time_point wake_time;
+
+      cHeadless_IO();
+      sSignal Read_Key();
+      void Timeout(int delay);
+      void Color(int red, int green, int blue);
+      void Output_Text(std::string text, int x, int y, int red, int green, int blue);
+      void Refresh();
+      bool Is_Blocked();
+
+  };
+
+  class cHost {
+
+    public:
+      cArray<std::string> names;
+      cArray<cHeadless_IO*> ios;
+      cArray<cSimulator*> simulators;
+      cArray<std::string> errors;
+      std::deque<int>* queues;
+      std::mutex* locks;
+      int worker_count;
+      std::atomic<int> remaining;
+      std::multimap<std::chrono::steady_clock::time_point, int> parked;
+      std::mutex park_lock;
+      std::condition_variable wake;
+      std::atomic<int> idle;
+
+      cHost();
+      ~cHost();
+      void Load_Programs(std::string list);
+      void Run();
+      void Work(int worker);
+      bool Take_Work(int worker, int& vm);
+      void Give_Work(int worker, int vm);
+      bool Has_Work();
+      void Park(int vm);
+      int Unpark(int worker);
+      void Wait_For_Work(int worker);
+      void Finish();
+      void Report(double seconds);
+
+  };
+
+  class cBenchmark {
+
+    public:
+      std::string suite;
+      std::string folder;
+      std::string config;
+      cArray<std::string> programs;
+      std::ofstream results;
+
+      cBenchmark(std::string suite);
+      void Generate_Source(std::string name, int line_count);
+      void Run();
+      void Run_Program(std::string name);
+      void Report(std::string name, std::string metric, std::vector<double>& samples);
+
+  };
+
+  class cServer {
+
+    public:
+      std::string path;
+      tSocket listener;
+      cArray<cSimulator*> simulators;
+      cArray<cHeadless_IO*> ios;
+      cArray<cSimulator*> pool;
+      std::mutex pool_lock;
+      std::map<tSocket, std::thread*> clients;
+      cArray<tSocket> finished;
+      std::mutex client_lock;
+      std::atomic<bool> stopping;
+
+      cServer(std::string name);
+      ~cServer();
+      void Run();
+      void Serve_Client(tSocket client);
+      void Reap_Clients();
+      std::string Handle_Request(std::string request);
+      cSimulator* Take_Simulator();
+      void Give_Simulator(cSimulator* simulator);
+      static void Start_Sockets();
+      static tSocket Open_Socket(std::string path, bool listen);
+      static bool Read_Line(tSocket client, std::string& line);
+      static void Send_Text(tSocket client, std::string text);
+      static void Send_Request(std::string name, std::string request);
+
+  };
+
+  class cDebugger {
+
+    public:
+      cSimulator* simulator;
+      cSymbols symbols;
+      std::map<int, int> breakpoints;
+      std::map<int, int> watches;
+      bool quitting;
+
+      cDebugger(cSimulator* simulator, std::string program);
+      ~cDebugger();
+      void Run(std::string script);
+      void Do_Command(std::string command);
+      int Get_Address(std::string text);
+      void Add_Breakpoint(int address);
+      void Remove_Breakpoint(int address);
+      int Read_Original(int address);
+      void Step(int count);
+      void Continue(long long limit);
+      bool Check_Watches();
+      void Print_Where();
+      void Print_Registers();
+      void Print_Memory(int address, int count);
+
+  };
+
+  class cConformance {
+
+    public:
+      std::mt19937 random;
+      int memory_size;
+      int screen;
+      int grid_size;
+      std::vector<int> levels;
+      std::vector<long long> instruction_hits;
+      std::vector<long long> mode_hits;
+      std::vector<long long> test_hits;
+      long long no_jumps;
+      long long pointer_writes;
+      long long zero_divides;
+      std::vector<int> model_threads;
+
+      cConformance(int seed);
+      void Run(int iterations, int budget);
+      sConform_Program Generate();
+      sGenerated Generate_Instruction(int routine, int slot, int slot_count, int& depth);
+      int Random(int count);
+      int Random_Value();
+      void Add_Read(std::vector<int>& words);
+      void Add_Write(std::vector<int>& words);
+      void Add_Range(std::vector<int>& words, int count);
+      std::vector<int> Encode(sConform_Program& program, std::vector<std::vector<int> >& addresses);
+      std::string Check(sConform_Program& program);
+      void Model_Step(std::vector<int>& memory, sModel_Thread& thread);
+      int Model_Read(std::vector<int>& memory, int address);
+      void Model_Write(std::vector<int>& memory, int address, int value);
+      void Model_Range(std::vector<int>& memory, int address, int count);
+      int Model_Fetch(std::vector<int>& memory, sModel_Thread& thread);
+      void Model_Store(std::vector<int>& memory, sModel_Thread& thread, int value);
+      void Shrink(sConform_Program& program);
+      void Save_Failure(sConform_Program& program, std::string message);
 
   };
 
@@ -109,15 +649,33 @@ namespace Codeloader {
       cArray<sToken> tokens;
       cHash<std::string, int> symtab;
       cHash<int, std::string> placeholders;
+      cHash<std::string, int> labels;
+      cHash<std::string, int> vectors;
+      cArray<sBlock> blocks;
+      std::vector<std::vector<int> > chains;
+      std::vector<bool> pinned;
+      std::vector<sReference> references;
+      std::map<int, int> reference_at;
       cSimulator* simulator;
       int pointer;
+      int line_count;
+      bool linking;
 
       cAssembler(cSimulator* simulator);
       void Load_Source(std::string name);
       void Compile_Source(std::string name);
+      void Save_Map(std::string name);
+      void Start_Block(std::string name);
+      void Mark_Block(std::string instruction, int start);
+      int Find_Block(int address);
+      void Link_Program(std::string name);
+      int Get_Chain_Size(int chain);
+      bool Apply_Profile(std::string name, std::vector<bool>& live, std::vector<int>& order, std::vector<int>& follows, std::vector<std::string>& fall_throughs);
+      bool Fall_Through(int from, int to, std::vector<bool>& live, std::vector<int>& order);
       sToken Parse_Token();
       void Parse_Keyword(std::string keyword);
       void Parse_String();
+      void Parse_Embed();
       void Parse_Address();
       void Parse_Value();
       void Parse_Value(std::string value);